@@ -73,9 +73,11 @@ extern "C" {
  *
  * @details
  * - Initial battery level: 100%
- * - Updates: Real-time battery level monitoring
+ * - Updates: VBAT is sampled in the background (SAADC, 16x oversampled,
+ *   8 Hz), filtered, and notified when the percentage changes
  *
- * @note Battery level is automatically updated during operation
+ * @note Below 3.7 V maximum speed and acceleration are scaled down, to 40% at
+ * 3.4 V, so hard moves don't brown the board out; see "power" in the status
  */
 #define BLE_SERVICE_BATTERY "Battery Service"
 
@@ -102,6 +104,14 @@ extern "C" {
  *
  * Commands are sent as single characters or strings over the BLE UART service.
  * All commands are processed in the main loop and provide immediate feedback.
+ *
+ * A line is its keyword (everything up to the first digit or '-', e.g.
+ * "config:slider:") followed by the arguments, if the command takes any.
+ * Arguments are decimal integers in the int32 range separated by ','; extra or
+ * missing arguments give "Error: Invalid parameter", as does text after a
+ * keyword that takes none.  An unknown keyword gives "Error: Invalid command".
+ * A line longer than 63 characters is not run at all and also gives
+ * "Error: Invalid parameter".
  */
 
 /**
@@ -136,11 +146,13 @@ extern "C" {
  * @brief Get device status
  *
  * @details
- * - Command: 's'
- * - Action: Returns current device status and position
- * - Response: JSON formatted status string
+ * - Command: "s" (newline terminated)
+ * - Action: Returns current device status and slider position, target and
+ *   speed (steps/s)
+ * - Response: JSON status object, see BLE_RESP_STATUS_FORMAT
  *
- * @note This command is planned for future implementation
+ * @note The reply is streamed without heap or printf, one notification per
+ * MTU sized chunk; "slider_sim --bench json" measures it on the host
  */
 #define BLE_CMD_STATUS 's'
 
@@ -148,11 +160,19 @@ extern "C" {
  * @brief Emergency stop
  *
  * @details
- * - Command: 'x'
- * - Action: Immediately stops all motor movement
- * - Response: "STOP" confirmation
- *
- * @note This command is planned for future implementation
+ * - Command: 'x' at the start of a line, acted on without waiting for '\n'
+ * - Action: both axes ramp to zero at 20000 steps/s^2 from whatever they are
+ *   doing (position move, jog, cruise, step table, path or replay). The stop
+ *   is requested as the bytes arrive from the BLE stack, ahead of lines
+ *   still waiting to be run, and the motion task applies it on its next pass.
+ * - Response: "STOP". Until it is sent, or for 1 s after the stop if the
+ *   line was lost, commands that move or reconfigure the slider get
+ *   "Error: Stopped", so nothing queued before the 'x' restarts motion.
+ * - Any peer may stop, whoever has control.
+ * - "stop?\n" replies "stop <n> times, latency <n> us, max <n> us", the time
+ *   from the 'x' arriving to the deceleration starting
+ *
+ * @note "slider_sim --max-stop-us N" fails a script whose stops took longer
  */
 #define BLE_CMD_STOP 'x'
 
@@ -180,6 +200,283 @@ extern "C" {
  */
 #define BLE_CMD_POSITION "pos:"
 
+/**
+ * @brief Velocity jog
+ *
+ * @details
+ * - Command: "j:<slider>,<rotator>\n"
+ * - Action: Sets signed jog speeds in steps/s for both axes. Speeds ramp
+ *   towards the setpoint, no position move is planned.
+ * - Deadman: if no setpoint arrives for 300 ms both axes ramp to zero, so
+ *   clients should stream setpoints at 5 Hz or faster while jogging
+ * - A limit switch trip stops the jog. While the switch is still pressed a
+ *   slider speed towards it gets "Error: At limit" and is not applied
+ * - "j?\n" replies "jog latency <n> us, max <n> us", the time from the line
+ *   arriving over BLE to the new speed reaching the steppers
+ *
+ * @note Position commands ('a', 'b') are ignored while jogging
+ * @see jog_velocity()
+ */
+#define BLE_CMD_JOG "j:"
+
+/**
+ * @brief Record and replay a manual jog
+ *
+ * @details
+ * - "rec:start" samples both axes at 50 Hz until "rec:stop" (or ~80 s of a
+ *   typical hand jog fills the 8 KB buffer)
+ * - "rec:play" drives to the recorded start then replays with the original
+ *   timing; "rec:play:<percent>" time-scales it (50 = half speed)
+ * - "rec:save" / "rec:load" store the recording in LittleFS
+ * - "rec?" replies sample count, bytes used, bytes per recorded minute and
+ *   the worst replay timing error
+ * - Response: "Command received and executed" or "Error: Device busy"
+ */
+#define BLE_CMD_RECORD "rec:"
+
+/**
+ * @brief Add a spline path keyframe
+ *
+ * @details
+ * - Command: "key:<position>,<angle>,<ms>"
+ * - Action: Appends a keyframe (up to 10); times must increase
+ * - Response: "Command received and executed" or "Error: Invalid parameter"
+ *
+ * @see BLE_CMD_PATH
+ */
+#define BLE_CMD_KEYFRAME "key:"
+
+/**
+ * @brief Run or clear the spline path
+ *
+ * @details
+ * - "path:run" drives to the first keyframe, then follows a smooth
+ *   Catmull-Rom curve through the rest, both axes together, evaluated at 100 Hz
+ * - "path:clear" removes all keyframes
+ * - Response: "Command received and executed" or "Error: Device busy"
+ */
+#define BLE_CMD_PATH "path:"
+
+/**
+ * @brief Ultra-slow constant velocity cruise
+ *
+ * @details
+ * - Command: "cruise:<slider>,<rotator>" in milli-steps per second, signed
+ *   (1000 = 1 step/s, max 2500000)
+ * - Action: Steps both axes from a 5 kHz hardware timer using 64-bit phase
+ *   accumulators: no drift over long timelapse runs and both axes stay
+ *   phase locked. "cruise:0,0" stops.
+ * - Response: "Command received and executed" or "Error: Invalid parameter"
+ */
+#define BLE_CMD_CRUISE "cruise:"
+
+/**
+ * @brief Precompiled step tables
+ *
+ * @details
+ * - "table:compile:<slider>,<rotator>" compiles relative moves with the
+ *   current speed and acceleration into a delta/run-length encoded table of
+ *   step intervals
+ * - "table:save" stores it in LittleFS
+ * - "table:run" streams the saved table to the steppers; every take
+ *   produces exactly the same step timing
+ * - "table?" replies table size, steps per axis and stream underruns
+ * - Response: "Command received and executed" or "Error: Device busy"
+ */
+#define BLE_CMD_TABLE "table:"
+
+/**
+ * @brief Round-trip probe
+ *
+ * @details
+ * - Command: "ping"
+ * - Response: "pong", sent as soon as the line is parsed, so the client can
+ *   time command round trips in each connection mode
+ */
+#define BLE_CMD_PING "ping"
+
+/**
+ * @brief Link report
+ *
+ * @details
+ * - Command: "link?"
+ * - Response: for each connected peer, one line per connection mode (idle,
+ *   active) with bytes received, throughput while data was flowing, replies
+ *   sent and the worst receive-to-reply turnaround; "link none" if no peer
+ *   is connected
+ */
+#define BLE_CMD_LINK "link?"
+
+/**
+ * @brief Connected peers
+ *
+ * @details
+ * - Command: "peers?"
+ * - Response: one line per connected central ("peer <n>", with '*' on the one
+ *   in control) with bytes received and sent, bytes dropped on full RX/TX
+ *   rings and control commands refused, then the telemetry frames serialized
+ *   and the copies sent
+ *
+ * @note Up to three centrals can be connected at once. Queries are open to
+ * all of them; the first to send a command that moves or reconfigures the
+ * slider takes control and keeps it while connected, moving or active in the
+ * last 10 s. Control commands from the others get "Error: Not in control".
+ */
+#define BLE_CMD_PEERS "peers?"
+
+/**
+ * @brief Give up control
+ *
+ * @details
+ * - Command: "release"
+ * - Response: "Command received and executed", whether or not this peer had
+ *   control
+ */
+#define BLE_CMD_RELEASE "release"
+
+/**
+ * @brief Status telemetry
+ *
+ * @details
+ * - Command: "watch:1" or "watch:0"
+ * - Action: sends this peer the status object every 500 ms until "watch:0"
+ *   or disconnect. It is formatted once and the same bytes go to every
+ *   watching peer.
+ * - Response: "Command received and executed"
+ */
+#define BLE_CMD_WATCH "watch:"
+
+/**
+ * @brief Task report
+ *
+ * @details
+ * - Command: "tasks?"
+ * - Response: one line per FreeRTOS task (motion, command, telemetry) with its
+ *   CPU share in permille, runs, longest run and stack never used. The
+ *   measurement window restarts with each report.
+ */
+#define BLE_CMD_TASKS "tasks?"
+
+/**
+ * @brief Input event log
+ *
+ * @details
+ * - "log:start" truncates /events.log and starts logging every BLE UART
+ *   frame with the peer that sent it, peer connect and disconnect, limit
+ *   switch trip and Serial input with the time it arrived. The file starts
+ *   with the axis positions, config, connected peers and the peer in control.
+ * - "log:stop" stops and writes out what is left; "log:flush" writes out
+ *   without stopping. Otherwise the RAM ring is written out only while the
+ *   motors are idle, and events are dropped if it fills first.
+ * - "log?" replies on/off, events, dropped events, bytes waiting in RAM and
+ *   bytes written
+ * - Copy the file off the device and run "slider_sim --replay events.log" to
+ *   feed the session back through the same code with the original timing
+ */
+#define BLE_CMD_LOG "log:"
+
+/**
+ * @brief Boot timing report
+ *
+ * @details
+ * - Command: "startup?"
+ * - Response: "boot motion <t> us, config <t> us, ble ..., services ...,
+ *   ready ..., advertising ..., connect ..., first move ..." in micros() since
+ *   reset, '-' for phases not reached yet
+ * - Motion hardware and the saved config come up first, then the SoftDevice,
+ *   all the GATT services (DFU, DIS, UART, battery) and the tasks, then
+ *   advertising. Only battery sampling starts after advertising.
+ */
+#define BLE_CMD_STARTUP "startup?"
+
+/**
+ * @brief Lifetime wear counters
+ *
+ * @details
+ * - Command: "wear?"
+ * - Response: binary, not a text line. 'W', the payload length in bytes,
+ *   then ten LEB128 varints: boots, flash writes of the counters, limit
+ *   switch hits, missed step deadlines, peak speed slider and rotator
+ *   (steps/s over 8 steps), steps slider and rotator (either direction, so
+ *   distance travelled), coil on time slider and rotator (s)
+ * - A missed deadline is a table step or stream sample more than 1 ms late,
+ *   or a table underrun.
+ * - "wear:save" writes the counters now, e.g. before switching off. Response:
+ *   ack, or "Error: Device busy" while moving.
+ *
+ * @note The counters are kept in RAM and written to flash while the motors
+ * are idle, at most every 5 min, so up to that much use is lost on power off.
+ */
+#define BLE_CMD_WEAR "wear?"
+
+/**
+ * @brief Clock synchronisation
+ *
+ * @details
+ * - "clock:<t1>" with t1 the central's clock in us replies
+ *   "clock <t1> <t2> <t3>", t2 and t3 the slider's clock as the line
+ *   arrived and as the reply was written
+ * - "sync:<t1>,<t2>,<t3>,<t4>" sends the exchange back with t4, the central's
+ *   clock when the reply arrived. Response: ack, or "Error: Invalid
+ *   parameter" if the round trip comes out negative.
+ * - "sync?" replies the estimated offset, skew (ppb, how much faster the
+ *   slider's crystal runs), quickest round trip and samples used, the
+ *   exchanges taken and rejected, then how many "when:" commands ran and how
+ *   late the last and the worst one started
+ * - All times are signed 32 bit microseconds that wrap.
+ * - Run an exchange about every 100 ms per slider. The quickest exchange of
+ *   each 4 s is kept; the offset comes from the last two, the skew from a
+ *   line through about a minute of them and is used once it is known to
+ *   within 3 ppm. Replays and paths started afterwards run on the central's
+ *   clock.
+ *
+ * @note Over BLE each leg waits for a connection event, so all sliders share
+ * an offset error of up to about half a connection interval; it cancels
+ * between sliders synced by the same central. "slider_sim --bench sync"
+ * reports the spread achieved over a mock link, see
+ * "--link-latency-us" and "--link-jitter-us".
+ */
+#define BLE_CMD_CLOCK "clock:"
+
+/**
+ * @brief Scheduled command
+ *
+ * @details
+ * - Command: "when:<t>:<command>", e.g. "when:12000000:path:run"
+ * - Action: runs command on the first motion timer tick (200 us) once the
+ *   central's clock reaches t (the slider's own clock until the first "sync:").
+ *   Send the same line to every slider to start them together, with t far
+ *   enough ahead for the slowest link. Move to a path's first key first, the
+ *   path starts with driving there.
+ * - Response: ack, then the command's own reply when it runs. "Error: Invalid
+ *   parameter" for an unknown or nested command or t in the past or more than
+ *   30 min ahead; "Error: Device busy" if four are already waiting.
+ * - 'x' drops whatever is waiting.
+ */
+#define BLE_CMD_WHEN "when:"
+
+/**
+ * @brief Motion configuration
+ *
+ * @details
+ * - "config:slider:<speed>,<accel>" / "config:rotator:<speed>,<accel>" set max
+ *   speed (steps/s) and acceleration (steps/s^2) for an axis
+ * - "config:hold:<axis>,<hold_ms>,<reduce_ms>" sets how long an axis (0 =
+ *   slider, 1 = rotator) keeps its coils on after it stops, -1 for ever and
+ *   at most 3600000 ms otherwise, and after how long the hold drops to
+ *   reduced current on drivers that have it (0 = never). Defaults 1000 ms
+ *   and 200 ms; 0 ms switches off as soon as a move ends.
+ * - "config:save" stores the limits in LittleFS, they are applied at boot
+ * - "config:load" / "config:reset" apply the saved limits or the defaults
+ * - "config?" reports the limits in use
+ * - "hold?" reports, per axis, the hold times and how often the coils were
+ *   switched on, off and (where supported) to reduced current, and for how
+ *   long they have been on
+ * - Response: "Settings saved", "Settings loaded", "Defaults restored", ack,
+ *   "Error: No saved settings" or "Error: Device busy" while moving
+ */
+#define BLE_CMD_CONFIG "config:"
+
 /** @} */  // end of ble_commands
 
 /**
@@ -203,6 +500,9 @@ extern "C" {
 #define BLE_RESP_ERROR "Error: Invalid command"
 #define BLE_RESP_PARAM_ERROR "Error: Invalid parameter"
 #define BLE_RESP_BUSY "Error: Device busy"
+#define BLE_RESP_NOT_IN_CONTROL "Error: Not in control"
+#define BLE_RESP_STOPPED "Error: Stopped"
+#define BLE_RESP_STOP "STOP"
 
 /**
  * @brief Status response format
@@ -214,9 +514,13 @@ extern "C" {
  *   "position": 1234,
  *   "target": 1234,
  *   "speed": 50,
- *   "battery": 85
+ *   "battery": 85,
+ *   "vbat": 3890,
+ *   "power": 1000
  * }
  * @endcode
+ * "vbat" is the filtered battery voltage in mV and "power" the battery speed
+ * limit in permille.
  */
 #define BLE_RESP_STATUS_FORMAT "JSON status object"
 
@@ -251,6 +555,12 @@ extern "C" {
  * - Auto LED: Enabled on connection
  * - Connection callbacks: Connect/Disconnect handlers
  * - Peer name retrieval: 32 character limit
+ * - Active (any data received in the last 3 s): 7.5-15 ms interval
+ *   requested, no slave latency
+ * - Idle: 100-120 ms interval, slave latency 4, first requested 1 s after
+ *   connecting so service discovery runs at the central's interval
+ * - On connect: 2M PHY, data length extension and a 247 byte MTU are
+ *   requested; the central decides what it grants
  */
 #define BLE_CONN_BANDWIDTH_MAX true
 #define BLE_CONN_AUTO_LED true
@@ -408,20 +718,19 @@ extern "C" {
 /**
  * @brief Data logging
  *
- * @details Planned features include:
+ * @details Lifetime usage counters are available, see BLE_CMD_WEAR.
+ * Planned features include:
  * - Movement history
  * - Performance metrics
  * - Error logging
- * - Usage statistics
  */
 #define BLE_FUTURE_LOGGING "Data logging capabilities"
 
 /**
  * @brief Multi-device support
  *
- * @details Planned features include:
- * - Multiple slider control
- * - Synchronized movements
+ * @details Synchronized starts across sliders are available, see
+ * BLE_CMD_CLOCK and BLE_CMD_WHEN. Planned features include:
  * - Master-slave configurations
  * - Network coordination
  */
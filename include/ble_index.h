@@ -110,7 +110,7 @@
  *
  * ### 📋 Planned
  * - Programmed movement sequences
- * - Multi-device coordination
+ * - Multi-device coordination beyond synchronized starts
  * - Advanced motion profiles
  * - Data logging and analytics
  * - Remote firmware updates
@@ -129,21 +129,45 @@
  *
  * @section command_reference_sec Command Reference
  *
+ * Every command the firmware accepts is in the table in `commands.cpp`;
+ * these lists follow it, see `ble_api.h` for the details.
+ *
  * ### Movement Commands
  * | Command | Description | Parameters | Response |
  * |---------|-------------|------------|----------|
  * | `a` | Move forward | None | "a intercept - change dir" |
  * | `b` | Move backward | None | "b intercept - change dir" |
- * | `pos:<value>` | Move to position | Integer position | "Moving to position X" |
- * | `speed:<value>` | Set speed | 1-100 | "Speed set to X" |
+ * | `j:<slider>,<rotator>` | Jog at signed steps/s | Two integers | None |
+ * | `j?` | Jog latency | None | Text report |
+ * | `rec:start` / `rec:stop` | Record a manual jog | None | Ack |
+ * | `rec:play[:<percent>]` | Replay the recording | Optional time scale | Ack |
+ * | `rec:save` / `rec:load` | Keep the recording in flash | None | Ack |
+ * | `rec?` | Recording size and replay timing | None | Text report |
+ * | `key:<pos>,<angle>,<ms>` | Add a path keyframe | Three integers | Ack |
+ * | `path:run` / `path:clear` | Run or drop the spline path | None | Ack |
+ * | `cruise:<slider>,<rotator>` | Constant speed, milli-steps/s | Two integers | Ack |
+ * | `table:compile:<slider>,<rotator>` | Compile a move to a step table | Two integers | Ack |
+ * | `table:save` / `table:run` | Store or run the step table | None | Ack |
+ * | `table?` | Table size and underruns | None | Text report |
  *
  * ### Control Commands
  * | Command | Description | Parameters | Response |
  * |---------|-------------|------------|----------|
  * | `s` | Get status | None | JSON status object |
+ * | `watch:1` / `watch:0` | Status every 500 ms | None | Ack |
+ * | `peers?` | Connected centrals, who has control | None | Text report |
+ * | `release` | Give up control | None | Ack |
  * | `x` | Emergency stop | None | "STOP" |
- * | `r` | Reset device | None | "RESET" |
- * | `h` | Go home | None | "Going home" |
+ * | `stop?` | Stop count and latency | None | Text report |
+ * | `clock:<t1>` | Clock exchange, first half | Central time, us | "clock t1 t2 t3" |
+ * | `sync:<t1>,<t2>,<t3>,<t4>` | Clock exchange, second half | Four integers | Ack |
+ * | `sync?` | Clock offset, skew and scheduled start lateness | None | Text report |
+ * | `when:<t>:<command>` | Run a command at central time t | Time, command | Ack, then the command's reply |
+ * | `ping` | Round-trip probe | None | "pong" |
+ * | `link?` | Per-peer throughput and turnaround | None | Text report |
+ * | `tasks?` | Task CPU share and stack | None | Text report |
+ * | `log:start` / `log:stop` / `log:flush` | Input event log | None | Ack |
+ * | `log?` | Event log state | None | Text report |
  *
  * ### Configuration Commands
  * | Command | Description | Parameters | Response |
@@ -151,6 +175,14 @@
  * | `config:save` | Save settings | None | "Settings saved" |
  * | `config:load` | Load settings | None | "Settings loaded" |
  * | `config:reset` | Reset to defaults | None | "Defaults restored" |
+ * | `config:slider:<speed>,<accel>` | Slider limits | Two integers | Ack |
+ * | `config:rotator:<speed>,<accel>` | Rotator limits | Two integers | Ack |
+ * | `config:hold:<axis>,<hold_ms>,<reduce_ms>` | Coil hold after a move | Three integers | Ack |
+ * | `config?` | Current limits | None | Text report |
+ * | `hold?` | Coil switching and on time | None | Text report |
+ * | `wear?` | Lifetime steps, peak speeds, limit hits, missed deadlines, coil time | None | Binary report |
+ * | `wear:save` | Write the wear counters to flash now | None | Ack |
+ * | `startup?` | Boot phase times | None | Text report |
  *
  * @section response_formats_sec Response Formats
  *
@@ -0,0 +1,87 @@
+// Arduino.h
+//
+// Minimal Arduino API for the native simulator build.  Time is virtual and
+// only moves when the simulator advances it (or firmware calls delay()), pin
+// writes are reported to the simulator so it can trace them.  See sim_arduino.h.
+
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define DEC 10
+#define HEX 16
+
+#define LED_RED 11
+#define LED_GREEN 12
+#define LED_BLUE 13
+
+#define SIM_PINS 32
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t val);
+int digitalRead(uint32_t pin);
+void digitalToggle(uint32_t pin);
+
+#define digitalPinToInterrupt(p) (p)
+void attachInterrupt(uint32_t pin, void (*isr)(void), uint32_t mode);
+
+void noInterrupts();
+void interrupts();
+
+// Firmware debug output, printed to stderr when the simulator is verbose.
+class SimSerial {
+ public:
+  void begin(unsigned long baud) {
+    (void)baud;
+  }
+  size_t write(uint8_t ch);
+  size_t write(const char* text);
+  size_t write(const uint8_t* buf, size_t len);
+  size_t print(const char* text);
+  size_t print(long v, int base = DEC);
+  size_t println(const char* text = "");
+  size_t println(long v, int base = DEC);
+  int available() {
+    return 0;
+  }
+  operator bool() {
+    return true;
+  }
+};
+
+extern SimSerial Serial;
+
+#endif  // SIM_ARDUINO_H
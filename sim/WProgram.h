@@ -0,0 +1,2 @@
+// WProgram.h - pre-1.0 Arduino name, AccelStepper includes it when ARDUINO is undefined.
+#include "Arduino.h"
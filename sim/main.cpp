@@ -0,0 +1,1444 @@
+// main.cpp
+//
+// Host trajectory simulator.  Runs the firmware's motion and command code in
+// virtual time against a command script and reports what the steppers did.
+//
+//   slider_sim [options] SCRIPT
+//     --csv FILE     per step CSV: t_us,axis,position,interval_us (0 on the
+//                    first step of a move)
+//     --vcd FILE     VCD waveform of the coil, limit and LED pins
+//     --loop-us N    run everything, motion pass included, every N us
+//                    instead of waking like the firmware (see below)
+//     --until MS     stop at this virtual time even if still moving
+//     --quiet        don't print command replies
+//     --serial       echo firmware Serial output to stderr
+//     --max-stop-us N  exit 1 if an emergency stop ('x') took longer than
+//                    this from request to deceleration
+//     --max-limit-steps N  exit 1 if the slider moved more than N steps
+//                    after a "!limit", up to the next script command
+//     --max-jog-us N exit 1 if a jog took longer than this from its line
+//                    arriving to the new speed reaching the steppers
+//   slider_sim [options] --replay FILE
+//     feed an event log (log:start on the device, or in a script) back in at
+//     its recorded times instead of a script
+//   slider_sim --bench spline|json|commands|peers|sync|hwstep|link|cruise
+//     timings and host checks; hwstep exits 1 if the hw_step engine emits
+//     an interval other than the one asked for or an e-stop ramp is off,
+//     link if the connection policy asks a mock BLEConnection for the wrong
+//     parameters, cruise if the cruise accumulator drifts over 8 h, spline
+//     if a 10 or 60 minute segment strays from the closed form by more than
+//     rounding
+//
+// By default motion passes run when the firmware's motion task would: on
+// each 200 us motion timer tick that task_motion_tick() wakes it for, at the
+// step deadlines of motion_next_step(), and straight after each motion
+// request.  RX and the command work are looked at every SIM_POLL_US and
+// always after the pass due at the same time, as the motion task would have
+// preempted them.
+//
+// The script is sent over the simulated BLE UART one line at a time, each
+// line followed by '\n'.  Lines may start with "@<ms> " to be delivered at
+// an absolute virtual time, and these directives are handled by the
+// simulator itself:
+//   !wait <ms>               let time pass
+//   !idle                    wait until motion has stopped and no "when:"
+//                            command is waiting
+//   !limit top|bottom        trip a limit switch, which stays pressed until
+//   !limit off               releases both
+//   !vbat <mV> [<ms>]        battery voltage, ramped linearly over ms; the
+//                            filter and speed limiter run every 500 ms once
+//                            a voltage is set
+//   !peer <n>|local          send the following lines as BLE peer n (a mock
+//                            connection, made on first use) or locally;
+//                            peer replies are shown as "<n "
+//   !drop <n>                disconnect peer n
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "battery.h"
+#include "ble_link.h"
+#include "boot.h"
+#include "clock_sync.h"
+#include "command_table.h"
+#include "commands.h"
+#include "event_log.h"
+#include "cruise.h"
+#include "hw_step.h"
+#include "motors.h"
+#include "peers.h"
+#include "sim_arduino.h"
+#include "spline.h"
+#include "tasks.h"
+#include "wear.h"
+
+#define SIM_AXES 2
+#define SIM_BIN_US 50000  // velocity/accel/jerk are sampled every 50 ms
+#define SIM_LINE_MAX 128
+#define SIM_POLL_US 10    // RX, commands and telemetry between motion wakes
+
+static const uint8_t trace_pins[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 10, 11, 12};
+static const char* const trace_names[] = {"top_limit", "bottom_limit", "slider_1", "slider_2",
+                                          "slider_3",  "slider_4",     "rotator_1", "rotator_2",
+                                          "rotator_3", "rotator_4",    "led_red",   "led_green"};
+#define TRACE_PINS (sizeof(trace_pins) / sizeof(trace_pins[0]))
+
+struct AxisStats {
+  long position;
+  uint32_t steps;
+  uint64_t first_us;
+  uint64_t last_us;
+  uint64_t last_interval;  // 0 at the start of each move
+  int8_t last_dir;
+  bool new_move;           // motion went idle since the last step
+  double jitter_sq;
+  uint32_t jitter_n;
+  uint64_t jitter_max;
+  uint64_t bin_start;
+  double v;
+  double a;
+  bool have_v;
+  bool have_a;
+  double peak_v;
+  double peak_a;
+  double peak_j;
+};
+
+static AxisStats axes[SIM_AXES];
+static FILE* csv = NULL;
+static FILE* vcd = NULL;
+static uint64_t vcd_last_t = UINT64_MAX;
+static bool quiet = false;
+
+// Synthetic battery trace, fed to the same filter and limiter as the SAADC.
+struct SimBattery {
+  bool active;
+  double from_mv;
+  double to_mv;
+  uint64_t ramp_start;
+  uint64_t ramp_end;
+  uint64_t next_us;
+  uint16_t min_scale;
+  Battery battery;
+};
+
+static SimBattery vbat;
+
+static uint8_t script_peer = COMMAND_LOCAL;
+
+// Slider travel after a "!limit", until the script sends its next command.
+struct LimitWatch {
+  uint32_t trips;
+  bool watching;
+  long position;  // where it was when the switch tripped
+  long moved_max;
+};
+
+static LimitWatch limit_watch;
+
+// Replies to a peer go through its TX ring like on the device.
+static void print_reply(const uint8_t* buf, size_t len) {
+  uint8_t source = command_source();
+  if (source != COMMAND_LOCAL) {
+    peers_write(ble_peers, source, buf, len);
+  } else if (!quiet) {
+    printf("< ");
+    fwrite(buf, 1, len, stdout);  // "wear?" is binary and may hold zeros
+  }
+}
+
+// Mock connections are handle n + 1 for "!peer n" and always have a buffer
+// free.  Each line is prefixed with the peer, wherever the chunks split it.
+static size_t print_peer(uint16_t conn, const uint8_t* buf, size_t len) {
+  static bool mid_line[PEER_MAX + 1];
+  bool& mid = mid_line[conn % (PEER_MAX + 1)];
+  for (size_t i = 0; i < len && !quiet; i++) {
+    if (!mid) {
+      printf("<%u ", conn - 1);
+    }
+    putchar(buf[i]);
+    mid = buf[i] != '\n';
+  }
+  return len;
+}
+
+static void vcd_hook(uint8_t pin, uint8_t level, uint64_t t_us) {
+  for (uint8_t i = 0; i < TRACE_PINS; i++) {
+    if (trace_pins[i] == pin) {
+      if (t_us != vcd_last_t) {
+        fprintf(vcd, "#%llu\n", (unsigned long long)t_us);
+        vcd_last_t = t_us;
+      }
+      fprintf(vcd, "%d%c\n", level, '!' + i);
+      return;
+    }
+  }
+}
+
+static void vcd_begin() {
+  fprintf(vcd, "$timescale 1us $end\n$scope module slider $end\n");
+  for (uint8_t i = 0; i < TRACE_PINS; i++) {
+    fprintf(vcd, "$var wire 1 %c %s $end\n", '!' + i, trace_names[i]);
+  }
+  fprintf(vcd, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+  for (uint8_t i = 0; i < TRACE_PINS; i++) {
+    fprintf(vcd, "%d%c\n", sim_pin_level(trace_pins[i]), '!' + i);
+  }
+  fprintf(vcd, "$end\n");
+  vcd_last_t = 0;
+  sim_set_pin_hook(vcd_hook);
+}
+
+static double fabs_d(double v) {
+  return v < 0 ? -v : v;
+}
+
+// Sample velocity (from the latest step interval) at each bin edge up to now,
+// updating the velocity, acceleration and jerk peaks.
+static void close_bins(AxisStats& s, uint64_t now) {
+  const double rate = 1e6 / SIM_BIN_US;
+  while (now - s.bin_start >= SIM_BIN_US) {
+    s.bin_start += SIM_BIN_US;
+    bool moving = s.last_interval && s.bin_start - s.last_us <= 2 * s.last_interval;
+    double v = moving ? s.last_dir * 1e6 / s.last_interval : 0;
+    if (s.have_v) {
+      double a = (v - s.v) * rate;
+      if (s.have_a && fabs_d((a - s.a) * rate) > s.peak_j) {
+        s.peak_j = fabs_d((a - s.a) * rate);
+      }
+      if (fabs_d(a) > s.peak_a) {
+        s.peak_a = fabs_d(a);
+      }
+      s.a = a;
+      s.have_a = true;
+    }
+    if (fabs_d(v) > s.peak_v) {
+      s.peak_v = fabs_d(v);
+    }
+    s.v = v;
+    s.have_v = true;
+  }
+}
+
+static void record_steps(uint64_t now) {
+  for (uint8_t axis = 0; axis < SIM_AXES; axis++) {
+    AxisStats& s = axes[axis];
+    close_bins(s, now);
+    long pos = motion_position(axis);
+    if (pos == s.position) {
+      continue;
+    }
+
+    uint64_t interval = s.steps && !s.new_move ? now - s.last_us : 0;
+    if (s.steps == 0) {
+      s.first_us = now;
+    }
+    if (interval && s.last_interval) {
+      uint64_t diff = interval > s.last_interval ? interval - s.last_interval
+                                                 : s.last_interval - interval;
+      s.jitter_sq += (double)diff * diff;
+      s.jitter_n++;
+      if (diff > s.jitter_max) {
+        s.jitter_max = diff;
+      }
+    }
+    s.last_dir = pos > s.position ? 1 : -1;
+    s.new_move = false;
+    s.steps += labs(pos - s.position);
+    s.last_interval = interval;
+    s.last_us = now;
+    s.position = pos;
+    if (csv) {
+      fprintf(csv, "%llu,%u,%ld,%llu\n", (unsigned long long)now, axis, pos,
+              (unsigned long long)interval);
+    }
+  }
+}
+
+static void print_summary(double wall_s) {
+  static const char* const names[SIM_AXES] = {"slider", "rotator"};
+  for (uint8_t axis = 0; axis < SIM_AXES; axis++) {
+    const AxisStats& s = axes[axis];
+    printf("%s: %u steps, end %ld, move %.3f s, peak %.1f steps/s, %.1f steps/s^2, "
+           "jerk %.0f steps/s^3, interval jitter rms %.1f us max %llu us\n",
+           names[axis], s.steps, s.position, s.steps ? (s.last_us - s.first_us) / 1e6 : 0.0,
+           s.peak_v, s.peak_a, s.peak_j, s.jitter_n ? sqrt(s.jitter_sq / s.jitter_n) : 0.0,
+           (unsigned long long)s.jitter_max);
+  }
+  double sim_s = sim_now_us() / 1e6;
+  for (uint8_t axis = 0; axis < SIM_AXES; axis++) {
+    const HoldAxis& hold = motion_hold(axis);
+    printf("%s coils: on %u times, off %u, on for %.3f s (%.0f%%)\n", names[axis],
+           hold.energized, hold.released, hold_on_us(hold, sim_now_us()) / 1e6,
+           sim_s > 0 ? hold_on_us(hold, sim_now_us()) / 1e4 / sim_s : 0.0);
+  }
+  const WearStats& life = wear.life;
+  printf("wear: %u boots, %u saves, steps %llu/%llu, peak %u/%u steps/s, %u limit hits, "
+         "%u missed deadlines, coils on %.1f/%.1f s\n",
+         life.boots, life.saves, (unsigned long long)life.steps[0],
+         (unsigned long long)life.steps[1], life.peak_speed[0], life.peak_speed[1],
+         life.limit_hits, life.missed, life.on_us[0] / 1e6, life.on_us[1] / 1e6);
+  if (vbat.active) {
+    printf("battery: %u mV filtered, %u%%, speed limit %u permille (lowest %u)\n",
+           vbat.battery.mv, battery_percent(vbat.battery.mv), vbat.battery.scale, vbat.min_scale);
+  }
+  if (limit_watch.trips) {
+    printf("limit: %u trips, slider moved %ld steps after one at most\n", limit_watch.trips,
+           limit_watch.moved_max);
+  }
+  if (estop_count()) {
+    printf("stop: %u times, latency last %u us, max %u us\n", estop_count(), estop_latency_us(),
+           estop_latency_max_us());
+  }
+  if (jog_latency_max_us()) {
+    printf("jog: latency last %u us, max %u us\n", jog_latency_us(), jog_latency_max_us());
+  }
+  printf("simulated %.3f s in %.3f s (%.0fx real time)\n", sim_s, wall_s,
+         wall_s > 0 ? sim_s / wall_s : 0.0);
+}
+
+// Motion task state for the default wake model.
+static bool motion_active;
+static bool step_armed;
+static uint32_t step_due_us;
+
+static void motion_pass() {
+  motion_run();
+  motion_active = motion_busy();
+  step_armed = motion_active && motion_next_step(step_due_us);
+  if (!motion_active) {
+    // A line sent on going idle may start the next move before record_steps().
+    axes[0].new_move = true;
+    axes[1].new_move = true;
+  }
+}
+
+// The request hook of tasks.cpp, without the task switch.
+static bool motion_request_pass(const MotionRequest& request) {
+  bool ok = motion_request_run(request);
+  motion_pass();
+  return ok;
+}
+
+// One script line arrives as one BLE frame, and is logged like one.  Peer
+// frames wait in the ring for the next peers_poll() like on the device.
+static void send_line(const char* line) {
+  uint8_t frame[SIM_LINE_MAX + 1];
+  size_t len = strlen(line);
+  memcpy(frame, line, len);
+  frame[len++] = '\n';
+  if (script_peer != COMMAND_LOCAL) {
+    peers_rx(ble_peers, script_peer, frame, len);
+    return;
+  }
+  evlog_input(event_log, EVLOG_BLE, frame, len, (uint32_t)sim_now_us());
+  for (size_t i = 0; i < len; i++) {
+    command_feed(frame[i]);
+  }
+}
+
+// Peer bytes still waiting for peers_poll().
+static bool peers_rx_pending() {
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    if (ble_peers.peer[id].rx.head != ble_peers.peer[id].rx.tail) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The peer on mock connection conn, connected on first use.
+static uint8_t sim_peer(uint16_t conn) {
+  uint8_t id = peers_find(ble_peers, conn);
+  if (id == PEER_NONE) {
+    id = peers_connect(ble_peers, conn, (uint32_t)sim_now_us());
+    peers_set_chunk(ble_peers, id, RESP_CHUNK_MAX);
+  }
+  return id;
+}
+
+static void log_limit(uint8_t pin) {
+  evlog_limit(event_log, pin, (uint32_t)sim_now_us());
+}
+
+struct Replay {
+  EvLogFileHeader header;
+  uint8_t* buf;
+  size_t len;
+  size_t pos;
+  uint64_t due_us;
+  EvLogEvent event;
+  bool pending;
+  bool done;
+};
+
+static bool replay_load(Replay& replay, const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  EvLogFileHeader& header = replay.header;
+  replay.len = size > (long)sizeof(header) ? size - sizeof(header) : 0;
+  replay.buf = (uint8_t*)malloc(replay.len + 1);
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == EVLOG_MAGIC &&
+            fread(replay.buf, 1, replay.len, file) == replay.len;
+  fclose(file);
+  if (!ok) {
+    fprintf(stderr, "%s: not an event log\n", path);
+  }
+  // Both clocks count from boot, so a log started at the same point after
+  // boot lines up to the microsecond.
+  replay.due_us = header.start_us;
+  return ok;
+}
+
+// Where the slider was as the log started, instead of config.bin and zero,
+// and who had control.
+// Peers already connected take their slots first; the rest are freed again
+// so later connects get the ids they got on the slider.
+static void replay_begin(const Replay& replay) {
+  const EvLogFileHeader& header = replay.header;
+  motion_config = header.config;
+  motion_configure(motion_config);
+  motion_set_position(header.position[0], header.position[1]);
+  for (uint8_t id = 0; id < PEER_MAX && header.peers >> id; id++) {
+    sim_peer(id + 1);
+  }
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    if (!(header.peers & 1 << id)) {
+      peers_disconnect(ble_peers, id + 1, (uint32_t)sim_now_us());
+    }
+  }
+  ble_peers.owner = header.owner;
+  ble_peers.owner_us = header.owner_us;
+}
+
+// Deliver every logged event that is due now.
+static void replay_step(Replay& replay) {
+  while (!replay.done) {
+    if (!replay.pending) {
+      size_t n = evlog_decode(replay.buf + replay.pos, replay.len - replay.pos, replay.event);
+      if (n == 0) {
+        replay.done = true;
+        return;
+      }
+      replay.pos += n;
+      replay.due_us += replay.event.dt_us;
+      replay.pending = true;
+    }
+    if (sim_now_us() < replay.due_us) {
+      return;
+    }
+    replay.pending = false;
+
+    const EvLogEvent& event = replay.event;
+    if (event.type == EVLOG_BLE || event.type == EVLOG_SERIAL) {
+      if (!quiet) {
+        printf("%s %.*s%s", event.type == EVLOG_BLE ? ">" : "serial>", event.len,
+               (const char*)event.payload, event.payload[event.len - 1] == '\n' ? "" : "\n");
+      }
+      if (event.type == EVLOG_SERIAL) {
+        continue;  // forwarded to the peers on the device, not run
+      } else if (event.peer != EVLOG_LOCAL) {
+        // Through the peer's ring like on the device, 'x' stops included.
+        peers_rx(ble_peers, event.peer, event.payload, event.len);
+      } else {
+        for (uint8_t i = 0; i < event.len; i++) {
+          command_feed(event.payload[i]);
+        }
+      }
+    } else if (event.type == EVLOG_LIMIT) {
+      sim_drive_pin(event.payload[0], 0);
+      sim_drive_pin(event.payload[0], 1);
+    } else if (event.type == EVLOG_CONNECT) {
+      // Mock connection id + 1; the slot is the first free one, as it was.
+      if (peers_find(ble_peers, event.peer + 1) == PEER_NONE &&
+          sim_peer(event.peer + 1) != event.peer) {
+        fprintf(stderr, "replay: peer %u connected in another slot\n", event.peer);
+      }
+    } else if (event.type == EVLOG_DISCONNECT) {
+      peers_disconnect(ble_peers, event.peer + 1, (uint32_t)sim_now_us());
+    } else {
+      fprintf(stderr, "replay: events were dropped before %.3f s\n", sim_now_us() / 1e6);
+    }
+  }
+}
+
+struct Script {
+  FILE* file;
+  char line[SIM_LINE_MAX];
+  bool pending;       // line read, waiting for its time
+  uint64_t due_us;
+  uint64_t resume_us; // set by !wait, no line is delivered before it
+  bool wait_idle;
+  bool done;
+};
+
+static bool script_read(Script& script) {
+  while (fgets(script.line, sizeof(script.line), script.file)) {
+    script.line[strcspn(script.line, "\r\n")] = '\0';
+    if (script.line[0] == '\0' || script.line[0] == '#') {
+      continue;
+    }
+    script.pending = true;
+    script.due_us = sim_now_us();
+    if (script.line[0] == '@') {
+      char* rest;
+      script.due_us = strtoull(script.line + 1, &rest, 10) * 1000;
+      memmove(script.line, rest + (*rest == ' '), strlen(rest + (*rest == ' ')) + 1);
+    }
+    if (script.due_us < script.resume_us) {
+      script.due_us = script.resume_us;
+    }
+    return true;
+  }
+  script.done = true;
+  return false;
+}
+
+// Deliver every script line that is due now.
+static void script_step(Script& script) {
+  while (!script.done) {
+    if (!script.pending && !script_read(script)) {
+      return;
+    }
+    if (script.wait_idle) {
+      if (peers_rx_pending() || motion_busy() || command_due_pending()) {
+        return;
+      }
+      script.wait_idle = false;
+    }
+    if (sim_now_us() < script.due_us) {
+      return;
+    }
+    script.pending = false;
+
+    const char* line = script.line;
+    if (strncmp(line, "!wait ", 6) == 0) {
+      script.resume_us = sim_now_us() + strtoull(line + 6, NULL, 10) * 1000;
+    } else if (strcmp(line, "!idle") == 0) {
+      script.wait_idle = true;
+    } else if (strncmp(line, "!vbat ", 6) == 0) {
+      char* rest;
+      double mv = strtod(line + 6, &rest);
+      uint64_t now = sim_now_us();
+      if (!vbat.active) {
+        vbat.active = true;
+        vbat.to_mv = mv;
+        vbat.next_us = now;
+        vbat.min_scale = 1000;
+        battery_init(vbat.battery);
+      }
+      vbat.from_mv = vbat.to_mv;
+      vbat.to_mv = mv;
+      vbat.ramp_start = now;
+      vbat.ramp_end = now + strtoull(rest, NULL, 10) * 1000;
+    } else if (strcmp(line, "!peer local") == 0) {
+      script_peer = COMMAND_LOCAL;
+    } else if (strncmp(line, "!peer ", 6) == 0) {
+      script_peer = sim_peer(strtoul(line + 6, NULL, 10) + 1);
+      if (script_peer == PEER_NONE) {
+        fprintf(stderr, "%s: only %u peers\n", line, PEER_MAX);
+        script_peer = COMMAND_LOCAL;
+      }
+    } else if (strncmp(line, "!drop ", 6) == 0) {
+      peers_disconnect(ble_peers, strtoul(line + 6, NULL, 10) + 1, (uint32_t)sim_now_us());
+      script_peer = COMMAND_LOCAL;
+    } else if (strcmp(line, "!limit off") == 0) {
+      sim_drive_pin(0, 1);
+      sim_drive_pin(1, 1);
+    } else if (strncmp(line, "!limit ", 7) == 0) {
+      limit_watch.trips++;
+      limit_watch.watching = true;
+      limit_watch.position = motion_position(0);
+      sim_drive_pin(strcmp(line + 7, "top") == 0 ? 0 : 1, 0);
+    } else {
+      limit_watch.watching = false;
+      if (!quiet) {
+        printf("> %s\n", line);
+      }
+      send_line(line);
+    }
+  }
+}
+
+// What the telemetry task does with each battery reading.
+static void battery_step(uint64_t now) {
+  if (!vbat.active || now < vbat.next_us) {
+    return;
+  }
+  vbat.next_us += TASK_TELEMETRY_MS * 1000;
+  double mv = vbat.to_mv;
+  if (now < vbat.ramp_end) {
+    mv = vbat.from_mv +
+         (vbat.to_mv - vbat.from_mv) * (now - vbat.ramp_start) / (vbat.ramp_end - vbat.ramp_start);
+  }
+  Battery& battery = vbat.battery;
+  if (battery_update(battery, (uint16_t)mv)) {
+    motion_set_power_scale(battery.scale);
+    if (battery.scale < vbat.min_scale) {
+      vbat.min_scale = battery.scale;
+    }
+    if (!quiet) {
+      printf("# %.3f s battery %u mV, speed limit %u permille\n", now / 1e6, battery.mv,
+             battery.scale);
+    }
+  }
+  command_set_battery(battery_percent(battery.mv), battery.mv);
+}
+
+// The segment's Hermite cubic evaluated directly, in double.
+static double spline_exact(const Spline& spline, uint8_t seg, uint8_t axis, double u) {
+  double m[2];
+  for (uint8_t end = 0; end < 2; end++) {
+    uint8_t i = seg + end;
+    m[end] = 0;
+    if (i > 0 && i < spline.count - 1) {
+      const SplineKey& prev = spline.keys[i - 1];
+      const SplineKey& next = spline.keys[i + 1];
+      m[end] = (double)(next.pos[axis] - prev.pos[axis]) / (next.t_ms - prev.t_ms) *
+               (spline.keys[seg + 1].t_ms - spline.keys[seg].t_ms);
+    }
+  }
+  double p0 = spline.keys[seg].pos[axis];
+  double p1 = spline.keys[seg + 1].pos[axis];
+  double u2 = u * u;
+  double u3 = u2 * u;
+  return (2 * u3 - 3 * u2 + 1) * p0 + (u3 - 2 * u2 + u) * m[0] + (-2 * u3 + 3 * u2) * p1 +
+         (u3 - u2) * m[1];
+}
+
+// Largest distance in steps between the ticks and the closed form over a
+// path of long segments, 10 and 60 minutes.
+static double spline_drift() {
+  Spline spline;
+  spline_clear(spline);
+  spline_add(spline, 0, 0, 0);
+  spline_add(spline, 40000, 3000, 600000);
+  spline_add(spline, 100000, -2000, 4200000);
+  spline_start(spline);
+  double worst = 0;
+  int32_t got[2];
+  while (spline_next(spline, got[0], got[1])) {
+    for (uint8_t axis = 0; axis < 2; axis++) {
+      double want = spline.tick == 0 || spline.seg + 1 >= spline.count
+                        ? spline.keys[spline.seg].pos[axis]
+                        : spline_exact(spline, spline.seg, axis,
+                                       (double)spline.tick / spline.seg_ticks);
+      if (fabs_d(got[axis] - want) > worst) {
+        worst = fabs_d(got[axis] - want);
+      }
+    }
+  }
+  return worst;
+}
+
+static int bench_spline() {
+  Spline spline;
+  spline_clear(spline);
+  for (int i = 0; i < SPLINE_KEYS_MAX; i++) {
+    spline_add(spline, (i * 7919) % 5000, (i * 104729) % 800 - 400, i * 2000);
+  }
+
+  uint64_t ticks = 0;
+  int32_t pos, angle;
+  auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < 2000; run++) {
+    spline_start(spline);
+    while (spline_next(spline, pos, angle)) {
+      ticks++;
+    }
+  }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("spline: %llu ticks in %.3f s, %.1f ns per control tick (incl. segment setup)\n",
+         (unsigned long long)ticks, s, s * 1e9 / ticks);
+  double drift = spline_drift();
+  printf("spline: %.2f steps from the closed form at most over 10 and 60 min segments\n", drift);
+  return drift < 0.6 ? 0 : 1;
+}
+
+static uint32_t bench_sink_bytes;
+
+static void bench_sink(const uint8_t* buf, size_t len) {
+  (void)buf;
+  bench_sink_bytes += len;
+}
+
+// Bytes per microsecond through the response writer for the "s" reply and a
+// worst case object (every integer at its longest), at the default and the
+// largest chunk size.  snprintf into a stack buffer is shown for scale.
+static int bench_json() {
+  const int runs = 1000000;
+  static const uint16_t chunks[] = {RESP_CHUNK_DEFAULT, RESP_CHUNK_MAX};
+  for (uint8_t c = 0; c < 2; c++) {
+    RespWriter w;
+    for (int worst = 0; worst < 2; worst++) {
+      resp_init(w, bench_sink, chunks[c]);
+      auto start = std::chrono::steady_clock::now();
+      for (int run = 0; run < runs; run++) {
+        if (worst) {
+          resp_obj_begin(w);
+          resp_field_str(w, "status", "moving");
+          resp_field_int(w, "position", INT32_MIN + run);
+          resp_field_int(w, "target", INT32_MIN);
+          resp_field_int(w, "speed", -2000000000 - run);
+          resp_field_int(w, "battery", 100);
+          resp_obj_end(w);
+          resp_char(w, '\n');
+        } else {
+          command_status(w);
+        }
+        resp_flush(w);
+      }
+      double us = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() *
+                  1e6;
+      printf("json %-6s chunk %3u: %4lu B/reply, %.1f B/us, %.0f ns per reply\n",
+             worst ? "worst" : "status", chunks[c], (unsigned long)(w.bytes / runs),
+             w.bytes / us, us * 1000 / runs);
+    }
+  }
+
+  char buf[128];
+  uint64_t bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < runs; run++) {
+    int n = snprintf(buf, sizeof(buf),
+                     "{\"status\":\"%s\",\"position\":%ld,\"target\":%ld,\"speed\":%ld,"
+                     "\"battery\":%d}\n",
+                     "moving", (long)INT32_MIN + run, (long)INT32_MIN, -2000000000L - run, 100);
+    bench_sink((const uint8_t*)buf, n);
+    bytes += n;
+  }
+  double us = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e6;
+  printf("json snprintf worst: %.1f B/us, %.0f ns per reply\n", bytes / us, us * 1000 / runs);
+  return 0;
+}
+
+// Lines per second through keyword matching alone, through the argument
+// parser, and through command_run() for commands that only reply.  strtol on
+// the same arguments is shown for scale.
+static int bench_commands() {
+  static const char* const lines[] = {
+      "s",           "ping",     "j:1200,-300", "config:rotator:1500,200", "key:5000,-400,12000",
+      "rec:play:50", "table?",   "link?",       "cruise:250000,-1000",     "bogus:1",
+  };
+  static const char* const replies[] = {"s", "ping", "config?", "table?", "j?", "bogus"};
+  const int runs = 1000000;
+  const size_t n_lines = sizeof(lines) / sizeof(lines[0]);
+  size_t lens[n_lines];
+  for (size_t i = 0; i < n_lines; i++) {
+    lens[i] = strlen(lines[i]);
+  }
+
+  uint32_t known = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < runs; run++) {
+    for (size_t i = 0; i < n_lines; i++) {
+      known += command_known(lines[i], lens[i]);
+    }
+  }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("commands match: %.1f M lines/s, %.1f ns per line (%u known)\n",
+         runs * n_lines / s / 1e6, s * 1e9 / (runs * n_lines), known / runs);
+
+  const char* args = "1500,-200";
+  int32_t v[2];
+  int64_t sum = 0;
+  start = std::chrono::steady_clock::now();
+  for (int run = 0; run < runs; run++) {
+    parse_ints(args, v, 2);
+    sum += v[0] + v[1];
+  }
+  s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("commands parse_ints \"%s\": %.1f ns\n", args, s * 1e9 / runs);
+
+  start = std::chrono::steady_clock::now();
+  for (int run = 0; run < runs; run++) {
+    char* end;
+    long a = strtol(args, &end, 10);
+    sum += a + strtol(end + 1, &end, 10);
+  }
+  s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("commands strtol \"%s\": %.1f ns (checksum %lld)\n", args, s * 1e9 / runs,
+         (long long)sum);
+
+  const size_t n_replies = sizeof(replies) / sizeof(replies[0]);
+  command_set_reply(bench_sink, RESP_CHUNK_MAX);
+  start = std::chrono::steady_clock::now();
+  for (int run = 0; run < runs; run++) {
+    for (size_t i = 0; i < n_replies; i++) {
+      command_run(replies[i], strlen(replies[i]));
+    }
+  }
+  s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("commands run with reply: %.2f M lines/s, %.0f ns per line\n",
+         runs * n_replies / s / 1e6, s * 1e9 / (runs * n_replies));
+  return 0;
+}
+
+// Mock connection for the peers benchmark: a few notifications per
+// connection event, as a phone grants.
+#define BENCH_EVENT_US 7500
+#define BENCH_NOTIFY_PER_EVENT 4
+
+static uint8_t bench_notify_left[PEER_MAX + 1];
+
+static void bench_peer_reply(const uint8_t* buf, size_t len) {
+  peers_write(ble_peers, command_source(), buf, len);
+}
+
+static size_t bench_peer_send(uint16_t conn, const uint8_t* buf, size_t len) {
+  (void)buf;
+  if (bench_notify_left[conn] == 0) {
+    return 0;
+  }
+  bench_notify_left[conn]--;
+  return len;
+}
+
+// 1 to PEER_MAX peers for 10 s of virtual time.  Every connection event peer
+// 0 sends a jog setpoint and a status request, the others a status request
+// and now and then a jog that arbitration refuses; all of them watch the
+// telemetry.  Reports what each peer got through and the host time per
+// connection event.
+static int bench_peers() {
+  const uint32_t events = 10000000 / BENCH_EVENT_US;
+  setup_steppers();
+  command_set_reply(bench_peer_reply, RESP_CHUNK_MAX);
+  for (uint8_t n = 1; n <= PEER_MAX; n++) {
+    peers_init(ble_peers);
+    for (uint8_t id = 0; id < n; id++) {
+      peers_connect(ble_peers, id + 1, 0);
+      peers_set_chunk(ble_peers, id, RESP_CHUNK_MAX);
+      peers_rx(ble_peers, id, (const uint8_t*)"watch:1\n", 8);
+    }
+
+    double busy_s = 0;
+    for (uint32_t e = 0; e < events; e++) {
+      uint32_t now = e * BENCH_EVENT_US;
+      auto start = std::chrono::steady_clock::now();
+      for (uint8_t id = 0; id < n; id++) {
+        char line[32];
+        int len = id == 0 ? snprintf(line, sizeof(line), "j:%d,0\ns\n", (int)(e % 800) - 400)
+                  : e % 100 == id ? snprintf(line, sizeof(line), "j:0,0\ns\n")
+                                  : snprintf(line, sizeof(line), "s\n");
+        peers_rx(ble_peers, id, (const uint8_t*)line, len);
+        bench_notify_left[id + 1] = BENCH_NOTIFY_PER_EVENT;
+      }
+      peers_poll(ble_peers, now);
+      peers_telemetry(ble_peers, now);
+      peers_send(ble_peers, bench_peer_send);
+      busy_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    printf("peers %u: %.2f us host time per connection event\n", n, busy_s * 1e6 / events);
+    for (uint8_t id = 0; id < n; id++) {
+      const PeerStats& stats = ble_peers.peer[id].stats;
+      printf("  peer %u%s: rx %lu B/s, tx %lu B/s, %lu lines, dropped %lu/%lu, refused %lu\n", id,
+             ble_peers.owner == id ? "*" : "", (unsigned long)(stats.rx_bytes / 10),
+             (unsigned long)(stats.tx_bytes / 10), (unsigned long)stats.lines,
+             (unsigned long)stats.rx_dropped, (unsigned long)stats.tx_dropped,
+             (unsigned long)stats.refused);
+    }
+    printf("  telemetry %lu frames serialized, %lu sends\n",
+           (unsigned long)ble_peers.telemetry_frames, (unsigned long)ble_peers.telemetry_sends);
+  }
+  return 0;
+}
+
+// Clock sync over a mock BLE link: every message waits for the unit's next
+// connection event, then link latency plus up to link jitter more.
+#define BENCH_SYNC_UNITS 3
+#define BENCH_SYNC_TRIALS 100
+#define BENCH_SYNC_EXCHANGES 640
+#define BENCH_SYNC_EVERY_US 100000
+#define BENCH_SYNC_PASS_US 200         // motion pass on the slider
+#define BENCH_SYNC_PROFILE_US 60000000
+
+static uint32_t link_latency_us = 0;
+static uint32_t link_jitter_us = 0;
+static uint32_t bench_rand_state = 1;
+
+static uint32_t bench_rand(uint32_t range) {
+  bench_rand_state = bench_rand_state * 1664525u + 1013904223u;
+  return range ? (uint32_t)(((uint64_t)(bench_rand_state >> 8) * range) >> 24) : 0;
+}
+
+struct BenchUnit {
+  double skew;     // true crystal error, local runs 1 + skew times faster
+  uint32_t origin;
+  uint64_t phase;  // first connection event, us
+  ClockSync sync;
+};
+
+static uint32_t unit_clock(const BenchUnit& unit, double t) {
+  return unit.origin + (uint32_t)llround(t * (1 + unit.skew));
+}
+
+static double unit_link(const BenchUnit& unit, double t) {
+  double k = ceil((t - unit.phase) / BENCH_EVENT_US);
+  return unit.phase + k * BENCH_EVENT_US + link_latency_us + bench_rand(link_jitter_us + 1);
+}
+
+static int bench_sync() {
+  double offset_sq = 0, offset_max = 0, skew_sq = 0, skew_max = 0;
+  double start_sq = 0, start_max = 0, end_sq = 0, end_max = 0, raw_max = 0;
+  uint32_t n = 0;
+  for (uint32_t trial = 0; trial < BENCH_SYNC_TRIALS; trial++) {
+    BenchUnit units[BENCH_SYNC_UNITS];
+    for (uint8_t i = 0; i < BENCH_SYNC_UNITS; i++) {
+      units[i].skew = ((double)bench_rand(80001) - 40000) * 1e-9;  // +-40 ppm
+      units[i].origin = bench_rand(0x1000000) << 8;
+      units[i].phase = bench_rand(BENCH_EVENT_US);
+      sync_init(units[i].sync);
+    }
+
+    double t = 1000000;
+    for (uint32_t e = 0; e < BENCH_SYNC_EXCHANGES; e++, t += BENCH_SYNC_EVERY_US) {
+      for (uint8_t i = 0; i < BENCH_SYNC_UNITS; i++) {
+        // App timers are not aligned with the connection events.
+        BenchUnit& u = units[i];
+        double sent = t + bench_rand(BENCH_SYNC_EVERY_US / 2);
+        double arrive = unit_link(u, sent);
+        double reply = arrive + 200 + bench_rand(400);  // through the command and motion tasks
+        sync_add(u.sync, (uint32_t)sent, unit_clock(u, arrive), unit_clock(u, reply),
+                 (uint32_t)unit_link(u, reply));
+      }
+    }
+
+    // "when:<T>:path:run" sent to every unit, T a second ahead.
+    double target = t + 1000000;
+    double start[BENCH_SYNC_UNITS], end[BENCH_SYNC_UNITS], raw[BENCH_SYNC_UNITS];
+    for (uint8_t i = 0; i < BENCH_SYNC_UNITS; i++) {
+      BenchUnit& u = units[i];
+      double offset = (int32_t)(sync_to_central(u.sync, unit_clock(u, target)) - (uint32_t)target);
+      double skew = u.sync.skew_ppb * 1e-9 - u.skew;
+      offset_sq += offset * offset;
+      skew_sq += skew * skew;
+      offset_max = fmax(offset_max, fabs(offset));
+      skew_max = fmax(skew_max, fabs(skew));
+
+      // Runs on the first pass once the local clock reaches the due time.
+      uint32_t due = sync_to_local(u.sync, (uint32_t)target);
+      int32_t wait = (int32_t)(due - unit_clock(u, target));
+      start[i] = target + (wait + (double)bench_rand(BENCH_SYNC_PASS_US)) / (1 + u.skew);
+      // The path's ticks are stretched by the estimated skew.
+      uint64_t ticks = BENCH_SYNC_PROFILE_US / SPLINE_TICK_US;
+      double local = ticks * (double)sync_period_q16(SPLINE_TICK_US, u.sync.skew_ppb) / 65536;
+      end[i] = start[i] + local / (1 + u.skew);
+      raw[i] = start[i] + BENCH_SYNC_PROFILE_US / (1 + u.skew);
+    }
+    for (uint8_t i = 0; i < BENCH_SYNC_UNITS; i++) {
+      for (uint8_t j = i + 1; j < BENCH_SYNC_UNITS; j++) {
+        double ds = start[i] - start[j], de = end[i] - end[j];
+        start_sq += ds * ds;
+        end_sq += de * de;
+        start_max = fmax(start_max, fabs(ds));
+        end_max = fmax(end_max, fabs(de));
+        raw_max = fmax(raw_max, fabs(raw[i] - raw[j]));
+        n++;
+      }
+    }
+  }
+  uint32_t m = BENCH_SYNC_TRIALS * BENCH_SYNC_UNITS;
+  printf("sync: %u units, %u trials, %u exchanges at %u ms, connection interval %.1f ms, "
+         "link latency %u us, jitter %u us\n",
+         BENCH_SYNC_UNITS, BENCH_SYNC_TRIALS, BENCH_SYNC_EXCHANGES, BENCH_SYNC_EVERY_US / 1000,
+         BENCH_EVENT_US / 1000.0, link_latency_us, link_jitter_us);
+  printf("  offset error rms %.0f us, max %.0f us\n", sqrt(offset_sq / m), offset_max);
+  printf("  skew error rms %.2f ppm, max %.2f ppm\n", sqrt(skew_sq / m) * 1e6, skew_max * 1e6);
+  printf("  start spread between units rms %.0f us, max %.0f us\n", sqrt(start_sq / n),
+         start_max);
+  printf("  after a %u s path rms %.0f us, max %.0f us (%.0f us without skew correction)\n",
+         BENCH_SYNC_PROFILE_US / 1000000, sqrt(end_sq / n), end_max, raw_max);
+  return 0;
+}
+
+// The cruise accumulator over 8 h of virtual time: steps emitted must match
+// cruise_expected_steps() after every tick that steps, and once a second.
+#define BENCH_CRUISE_S (8 * 3600)
+
+static int bench_cruise() {
+  static const int32_t speeds[] = {1, 1000, 4999, -7919, 333333, -(int32_t)CRUISE_MAX_MSPS};
+  bool all_ok = true;
+  auto start = std::chrono::steady_clock::now();
+  for (uint8_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+    CruiseAxis axis;
+    cruise_set(axis, speeds[i]);
+    int64_t drift_max = 0;
+    uint64_t ticks = 0;
+    for (uint32_t second = 0; second < BENCH_CRUISE_S; second++) {
+      for (uint32_t n = 0; n < CRUISE_TICK_HZ; n++) {
+        ticks++;
+        if (cruise_tick(axis) || n == CRUISE_TICK_HZ - 1) {
+          int64_t drift = axis.steps - cruise_expected_steps(speeds[i], ticks);
+          if (drift < 0) {
+            drift = -drift;
+          }
+          if (drift > drift_max) {
+            drift_max = drift;
+          }
+        }
+      }
+    }
+    bool ok = drift_max == 0;
+    all_ok &= ok;
+    printf("cruise %d msteps/s: %d steps after %u h (expected %lld), max drift %lld: %s\n",
+           speeds[i], axis.steps, BENCH_CRUISE_S / 3600,
+           (long long)cruise_expected_steps(speeds[i], ticks), (long long)drift_max,
+           ok ? "ok" : "FAIL");
+  }
+  double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double ticks = (double)BENCH_CRUISE_S * CRUISE_TICK_HZ * (sizeof(speeds) / sizeof(speeds[0]));
+  printf("cruise: %.1f ns per tick\n", s * 1e9 / ticks);
+  return all_ok ? 0 : 1;
+}
+
+// BLEConnection stand-in for the link policy check: records what was asked
+// for, and can refuse parameter requests as the SoftDevice does when busy.
+struct MockConnection {
+  uint8_t phy;
+  bool data_length;
+  uint16_t mtu;
+  uint16_t min_interval, max_interval, latency, timeout;
+  uint32_t param_requests;
+  bool busy;
+
+  bool requestPHY(uint8_t value) {
+    phy = value;
+    return true;
+  }
+  bool requestDataLengthUpdate() {
+    data_length = true;
+    return true;
+  }
+  bool requestMtuExchange(uint16_t value) {
+    mtu = value;
+    return true;
+  }
+  bool requestConnectionParameters(uint16_t min_value, uint16_t max_value, uint16_t latency_value,
+                                   uint16_t timeout_value) {
+    if (busy) {
+      return false;
+    }
+    min_interval = min_value;
+    max_interval = max_value;
+    latency = latency_value;
+    timeout = timeout_value;
+    param_requests++;
+    return true;
+  }
+};
+
+static uint32_t bench_failures;
+
+static void bench_expect(bool ok, const char* what) {
+  printf("  %-58s %s\n", what, ok ? "ok" : "FAIL");
+  bench_failures += !ok;
+}
+
+static bool mock_idle(const MockConnection& conn) {
+  return conn.min_interval == LINK_IDLE_INTERVAL_MIN &&
+         conn.max_interval == LINK_IDLE_INTERVAL_MAX && conn.latency == LINK_IDLE_LATENCY;
+}
+
+static bool mock_active(const MockConnection& conn) {
+  return conn.min_interval == LINK_ACTIVE_INTERVAL_MIN &&
+         conn.max_interval == LINK_ACTIVE_INTERVAL_MAX && conn.latency == LINK_ACTIVE_LATENCY;
+}
+
+static int bench_link() {
+  bench_failures = 0;
+  LinkPolicy link;
+  MockConnection conn = {};
+  uint32_t t = 5000000;
+  printf("link: idle, active and streaming against a mock connection\n");
+  link_init(link);
+  link_connected(link, conn, t);
+  bench_expect(conn.phy == LINK_PHY_2M && conn.data_length && conn.mtu == LINK_MTU,
+               "connect asks for 2M PHY, DLE and the MTU");
+  link_update(link, conn, t + LINK_SETTLE_US / 2);
+  bench_expect(conn.param_requests == 0, "no idle request during service discovery");
+  link_update(link, conn, t + LINK_SETTLE_US);
+  bench_expect(conn.param_requests == 1 && mock_idle(conn) && conn.timeout == LINK_SUP_TIMEOUT,
+               "idle range once discovery has had its second");
+
+  t += 2000000;
+  link_rx(link, 20, t);
+  conn.busy = true;
+  link_update(link, conn, t);
+  bench_expect(link.mode == LINK_ACTIVE && link.pending, "rx goes active, busy stack retried");
+  conn.busy = false;
+  link_update(link, conn, t + 1000);
+  bench_expect(conn.param_requests == 2 && mock_active(conn), "active range on the retry");
+
+  // Jog setpoints every 15 ms for 10 s.
+  for (uint32_t i = 1; i <= 667; i++) {
+    t += 15000;
+    link_rx(link, 20, t);
+    link_update(link, conn, t + 500);
+  }
+  bench_expect(conn.param_requests == 2 && link.mode == LINK_ACTIVE,
+               "streaming stays active without new requests");
+  uint32_t rate = link_throughput(link, LINK_ACTIVE);
+  bench_expect(rate >= 1330 && rate <= 1336, "streaming throughput 20 B per 15 ms");
+  link_update(link, conn, t + LINK_IDLE_AFTER_US);
+  bench_expect(conn.param_requests == 2, "still active at the idle timeout");
+  link_update(link, conn, t + LINK_IDLE_AFTER_US + 1);
+  bench_expect(conn.param_requests == 3 && mock_idle(conn) && link.mode == LINK_IDLE,
+               "idle range after the timeout");
+
+  // A client that sends at once gets the short interval during discovery.
+  conn = MockConnection();
+  link_init(link);
+  link_connected(link, conn, t);
+  link_rx(link, 20, t + 200000);
+  link_update(link, conn, t + 200000);
+  link_update(link, conn, t + LINK_SETTLE_US + 1);
+  bench_expect(conn.param_requests == 1 && mock_active(conn),
+               "early traffic: active at once, no idle request");
+  return bench_failures ? 1 : 0;
+}
+
+// hw_step against its mock HAL: every step the mock plays back must come
+// the requested interval after the previous one, across fillers and refills,
+// and a stop part way through must count only the steps that were emitted.
+#define BENCH_HW_STEPS 3000
+
+struct BenchIntervals {
+  const uint32_t* want;
+  uint32_t n;
+  uint32_t next;        // source position
+  uint32_t emitted;
+  uint32_t last_us;
+  uint32_t bad;
+  uint32_t stop_after;  // hw_step_stop() after this many steps, 0 = never
+  HwStepEngine* engine;
+};
+
+static uint32_t bench_interval_next(void* ctx) {
+  BenchIntervals& b = *(BenchIntervals*)ctx;
+  return b.next < b.n ? b.want[b.next++] : 0;
+}
+
+static void bench_interval_step(uint32_t t_us, void* ctx) {
+  BenchIntervals& b = *(BenchIntervals*)ctx;
+  uint32_t want = b.want[b.emitted];
+  if (want <= HW_STEP_PULSE_US) {
+    want = HW_STEP_PULSE_US + 1;
+  }
+  if (t_us - b.last_us != want) {
+    if (b.bad++ == 0) {
+      printf("  step %u after %u us, wanted %u us\n", b.emitted, t_us - b.last_us, want);
+    }
+  }
+  b.last_us = t_us;
+  if (++b.emitted == b.stop_after) {
+    hw_step_stop(*b.engine);
+  }
+}
+
+static bool bench_hw_case(const char* name, const uint32_t* want, uint32_t n,
+                          uint32_t stop_after) {
+  static HwStepEngine engine;
+  BenchIntervals b = {want, n, 0, 0, 0, 0, stop_after, &engine};
+  hw_step_init(engine, &hw_step_mock_hal);
+  hw_step_start(engine, bench_interval_next, &b);
+  uint32_t end_us = hw_step_mock_run(engine, bench_interval_step, &b);
+  uint32_t expect = stop_after ? stop_after : n;
+  bool ok = !b.bad && b.emitted == expect && engine.steps == expect && !engine.running;
+  printf("hwstep %s: %u steps in %.3f s, %u refills, counted %u, %u bad intervals: %s\n", name,
+         b.emitted, end_us / 1e6, engine.refills, engine.steps, b.bad, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+static int bench_hwstep() {
+  static uint32_t ramp_want[BENCH_HW_STEPS];
+  HwStepRamp ramp;
+  hw_step_ramp_init(ramp, BENCH_HW_STEPS, 4000, 8000);
+  for (uint32_t i = 0; i < BENCH_HW_STEPS; i++) {
+    ramp_want[i] = hw_step_ramp_next(&ramp);
+  }
+  // Around the 32767 tick counter limit, and too short to hold the pulse.
+  static const uint32_t long_want[] = {100,   40000, 5,      32767, 32768,  32771, 32772,
+                                       65534, 65536, 100000, 3,     70000,  1000,  250,
+                                       98301, 32767, 1,      65540, 400000, 7};
+  static uint32_t mixed_want[BENCH_HW_STEPS];
+  for (uint32_t i = 0; i < BENCH_HW_STEPS; i++) {
+    mixed_want[i] = i % 7 ? ramp_want[i] : long_want[i % 20];
+  }
+
+  // An e-stop at full speed: 4000 steps/s down at ESTOP_DECEL should take
+  // 200 ms and 400 steps, never speeding up on the way.
+  static uint32_t estop_want[BENCH_HW_STEPS];
+  hw_step_ramp_init(ramp, BENCH_HW_STEPS, 4000, 8000);
+  uint32_t estop_n = 0;
+  uint32_t stop_us = 0;
+  bool slowing = true;
+  for (uint32_t interval; (interval = hw_step_ramp_next(&ramp)) != 0; estop_n++) {
+    if (estop_n == 1500) {
+      hw_step_ramp_stop(ramp, ESTOP_DECEL);
+    } else if (estop_n > 1500) {
+      slowing &= interval >= estop_want[estop_n - 1];
+      stop_us += interval;
+    }
+    estop_want[estop_n] = interval;
+  }
+  float want_us = 4000.0f / ESTOP_DECEL * 1e6f;
+  bool estop_ok = slowing && estop_n == 1500 + 400 && fabsf(stop_us - want_us) < want_us * 0.05f;
+  printf("hwstep estop ramp: %u steps after the stop in %.1f ms: %s\n", estop_n - 1500,
+         stop_us / 1e3, estop_ok ? "ok" : "FAIL");
+
+  bool ok = bench_hw_case("ramp", ramp_want, BENCH_HW_STEPS, 0);
+  ok &= bench_hw_case("long", long_want, sizeof(long_want) / sizeof(long_want[0]), 0);
+  ok &= bench_hw_case("mixed", mixed_want, BENCH_HW_STEPS, 0);
+  ok &= bench_hw_case("stopped", ramp_want, BENCH_HW_STEPS, 1234);
+  ok &= bench_hw_case("stopped mixed", mixed_want, BENCH_HW_STEPS, 77);
+  ok &= bench_hw_case("estop", estop_want, estop_n, 0);
+  return ok && estop_ok ? 0 : 1;
+}
+
+static int usage() {
+  fprintf(stderr,
+          "usage: slider_sim [--csv FILE] [--vcd FILE] [--loop-us N] [--until MS] "
+          "[--quiet] [--serial] [--max-stop-us N] [--max-limit-steps N]\n"
+          "       [--max-jog-us N] [--wear FILE] SCRIPT|--replay FILE\n"
+          "       slider_sim [--link-latency-us N] [--link-jitter-us N] "
+          "--bench spline|json|commands|peers|sync|hwstep|link|cruise\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  const char* script_path = NULL;
+  const char* replay_path = NULL;
+  uint32_t loop_us = 0;
+  uint64_t until_us = 0;
+  uint32_t max_stop_us = 0;
+  long max_limit_steps = -1;
+  uint32_t max_jog_us = 0;
+  const char* bench = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--bench") == 0 && has_value) {
+      bench = argv[++i];
+    } else if (strcmp(arg, "--link-latency-us") == 0 && has_value) {
+      link_latency_us = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--link-jitter-us") == 0 && has_value) {
+      link_jitter_us = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--csv") == 0 && has_value) {
+      csv = fopen(argv[++i], "w");
+    } else if (strcmp(arg, "--vcd") == 0 && has_value) {
+      vcd = fopen(argv[++i], "w");
+    } else if (strcmp(arg, "--loop-us") == 0 && has_value) {
+      loop_us = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--until") == 0 && has_value) {
+      until_us = strtoull(argv[++i], NULL, 10) * 1000;
+    } else if (strcmp(arg, "--replay") == 0 && has_value) {
+      replay_path = argv[++i];
+    } else if (strcmp(arg, "--wear") == 0 && has_value) {
+      wear_set_file(argv[++i]);
+    } else if (strcmp(arg, "--max-limit-steps") == 0 && has_value) {
+      max_limit_steps = strtol(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--max-jog-us") == 0 && has_value) {
+      max_jog_us = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--max-stop-us") == 0 && has_value) {
+      max_stop_us = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--quiet") == 0) {
+      quiet = true;
+    } else if (strcmp(arg, "--serial") == 0) {
+      sim_serial_echo(true);
+    } else if (arg[0] != '-' && !script_path) {
+      script_path = arg;
+    } else {
+      return usage();
+    }
+  }
+  if (bench) {
+    if (strcmp(bench, "spline") == 0) {
+      return bench_spline();
+    } else if (strcmp(bench, "json") == 0) {
+      return bench_json();
+    } else if (strcmp(bench, "commands") == 0) {
+      return bench_commands();
+    } else if (strcmp(bench, "peers") == 0) {
+      return bench_peers();
+    } else if (strcmp(bench, "sync") == 0) {
+      return bench_sync();
+    } else if (strcmp(bench, "hwstep") == 0) {
+      return bench_hwstep();
+    } else if (strcmp(bench, "link") == 0) {
+      return bench_link();
+    } else if (strcmp(bench, "cruise") == 0) {
+      return bench_cruise();
+    }
+    return usage();
+  }
+  if (!script_path == !replay_path) {
+    return usage();
+  }
+
+  Script script = {};
+  Replay replay = {};
+  if (replay_path) {
+    if (!replay_load(replay, replay_path)) {
+      return 1;
+    }
+    script.done = true;
+  } else {
+    script.file = fopen(script_path, "r");
+    if (!script.file) {
+      perror(script_path);
+      return 1;
+    }
+    replay.done = true;
+    motion_set_limit_hook(log_limit);
+  }
+  if (csv) {
+    fprintf(csv, "t_us,axis,position,interval_us\n");
+  }
+
+  // Same order as setup() on the device; config.bin in the working directory
+  // stands in for the flash copy, or a replay takes the config from the log,
+  // and the wear counters start fresh unless --wear.
+  setup_steppers();
+  peers_init(ble_peers);
+  boot_mark(BOOT_MOTION, (uint32_t)sim_now_us());
+  if (!replay_path && config_load(motion_config)) {
+    motion_configure(motion_config);
+  }
+  wear_begin(wear, (uint32_t)sim_now_us());
+  if (replay_path) {
+    replay_begin(replay);
+  }
+  boot_mark(BOOT_CONFIG, (uint32_t)sim_now_us());
+  command_set_reply(print_reply, RESP_CHUNK_MAX);
+  boot_mark(BOOT_READY, (uint32_t)sim_now_us());
+  if (vcd) {
+    vcd_begin();
+  }
+  for (uint8_t axis = 0; axis < SIM_AXES; axis++) {
+    axes[axis].position = motion_position(axis);
+    axes[axis].bin_start = sim_now_us();
+  }
+
+  const uint32_t tick_us = 1000000 / CRUISE_TICK_HZ;
+  uint64_t next_tick = sim_now_us();
+  auto start = std::chrono::steady_clock::now();
+  if (!loop_us) {
+    motion_set_request_hook(motion_request_pass);
+  }
+  while (true) {
+    if (loop_us) {
+      peers_poll(ble_peers, (uint32_t)sim_now_us());
+      script_step(script);
+      replay_step(replay);
+      battery_step(sim_now_us());
+      command_run_due((uint32_t)sim_now_us());
+      table_refill();
+      motion_run();
+      wear_poll(wear, !motion_busy(), (uint32_t)sim_now_us());
+      while (sim_now_us() >= next_tick) {
+        motion_timer_tick();
+        next_tick += tick_us;
+      }
+    } else {
+      // The motion timer interrupt and the motion task it wakes, then the
+      // lower priority work.
+      bool tick = sim_now_us() >= next_tick;
+      bool wake = false;
+      if (tick) {
+        motion_timer_tick();
+        next_tick += tick_us;
+        wake = task_motion_tick(motion_active);
+      }
+      if (step_armed && (int32_t)((uint32_t)sim_now_us() - step_due_us) >= 0) {
+        step_armed = false;
+        wake |= task_motion_tick(motion_active);
+      }
+      if (wake) {
+        motion_pass();
+      }
+      peers_poll(ble_peers, (uint32_t)sim_now_us());
+      script_step(script);
+      replay_step(replay);
+      battery_step(sim_now_us());
+      if (tick) {
+        command_run_due((uint32_t)sim_now_us());
+      }
+      table_refill();
+      wear_poll(wear, !motion_busy(), (uint32_t)sim_now_us());
+    }
+    record_steps(sim_now_us());
+    if (limit_watch.watching && labs(motion_position(0) - limit_watch.position) >
+                                    limit_watch.moved_max) {
+      limit_watch.moved_max = labs(motion_position(0) - limit_watch.position);
+    }
+    if (motion_busy()) {
+      boot_mark(BOOT_FIRST_MOVE, (uint32_t)sim_now_us());
+    } else {
+      axes[0].new_move = true;
+      axes[1].new_move = true;
+    }
+    if (!replay_path) {
+      evlog_poll(event_log, !motion_busy(), (uint32_t)sim_now_us());
+    }
+    peers_telemetry(ble_peers, (uint32_t)sim_now_us());
+    peers_send(ble_peers, print_peer);
+
+    if (until_us ? sim_now_us() >= until_us
+                 : (script.done && replay.done && !peers_rx_pending() && !motion_busy() &&
+                    !command_due_pending())) {
+      break;
+    }
+    if (loop_us) {
+      sim_advance(loop_us);
+      continue;
+    }
+    uint64_t now = sim_now_us();
+    uint64_t next = now + SIM_POLL_US < next_tick ? now + SIM_POLL_US : next_tick;
+    if (step_armed) {
+      int32_t wait = (int32_t)(step_due_us - (uint32_t)now);
+      uint64_t due = now + (wait > 0 ? wait : 1);
+      next = due < next ? due : next;
+    }
+    sim_advance(next - now);
+  }
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  print_summary(wall);
+  if (csv) {
+    fclose(csv);
+  }
+  if (vcd) {
+    fclose(vcd);
+  }
+  if (script.file) {
+    fclose(script.file);
+  }
+  free(replay.buf);
+  evlog_request(event_log, EVLOG_REQ_STOP);
+  evlog_poll(event_log, true, (uint32_t)sim_now_us());
+  if (max_stop_us && estop_latency_max_us() > max_stop_us) {
+    fprintf(stderr, "stop latency %u us over %u us\n", estop_latency_max_us(), max_stop_us);
+    return 1;
+  }
+  if (max_limit_steps >= 0 && limit_watch.moved_max > max_limit_steps) {
+    fprintf(stderr, "slider moved %ld steps after a limit trip, over %ld\n",
+            limit_watch.moved_max, max_limit_steps);
+    return 1;
+  }
+  if (max_jog_us && jog_latency_max_us() > max_jog_us) {
+    fprintf(stderr, "jog latency %u us over %u us\n", jog_latency_max_us(), max_jog_us);
+    return 1;
+  }
+  return 0;
+}
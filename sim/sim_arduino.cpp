@@ -0,0 +1,139 @@
+// sim_arduino.cpp
+
+#include <stdio.h>
+
+#include "Arduino.h"
+#include "sim_arduino.h"
+
+SimSerial Serial;
+
+static uint64_t now_us = 0;
+static uint8_t levels[SIM_PINS];
+static void (*isrs[SIM_PINS])(void);
+static uint8_t isr_modes[SIM_PINS];
+static SimPinHook pin_hook = NULL;
+static bool serial_echo = false;
+
+uint64_t sim_now_us() {
+  return now_us;
+}
+
+void sim_advance(uint64_t us) {
+  now_us += us;
+}
+
+void sim_set_pin_hook(SimPinHook hook) {
+  pin_hook = hook;
+}
+
+uint8_t sim_pin_level(uint8_t pin) {
+  return pin < SIM_PINS ? levels[pin] : LOW;
+}
+
+void sim_drive_pin(uint8_t pin, uint8_t level) {
+  if (pin >= SIM_PINS || levels[pin] == level) {
+    return;
+  }
+  levels[pin] = level;
+  if (pin_hook) {
+    pin_hook(pin, level, now_us);
+  }
+  uint8_t mode = isr_modes[pin];
+  bool fire = mode == CHANGE || (mode == FALLING && level == LOW) ||
+              (mode == RISING && level == HIGH);
+  if (isrs[pin] && fire) {
+    isrs[pin]();
+  }
+}
+
+void sim_serial_echo(bool on) {
+  serial_echo = on;
+}
+
+uint32_t micros() {
+  return (uint32_t)now_us;
+}
+
+uint32_t millis() {
+  return (uint32_t)(now_us / 1000);
+}
+
+void delay(uint32_t ms) {
+  now_us += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(uint32_t us) {
+  now_us += us;
+}
+
+void yield() {}
+
+void pinMode(uint32_t pin, uint32_t mode) {
+  if (pin < SIM_PINS && mode == INPUT_PULLUP) {
+    levels[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint32_t pin, uint32_t val) {
+  if (pin >= SIM_PINS || levels[pin] == (val ? HIGH : LOW)) {
+    return;
+  }
+  levels[pin] = val ? HIGH : LOW;
+  if (pin_hook) {
+    pin_hook(pin, levels[pin], now_us);
+  }
+}
+
+int digitalRead(uint32_t pin) {
+  return sim_pin_level(pin);
+}
+
+void digitalToggle(uint32_t pin) {
+  digitalWrite(pin, !sim_pin_level(pin));
+}
+
+void attachInterrupt(uint32_t pin, void (*isr)(void), uint32_t mode) {
+  if (pin < SIM_PINS) {
+    isrs[pin] = isr;
+    isr_modes[pin] = mode;
+  }
+}
+
+void noInterrupts() {}
+void interrupts() {}
+
+size_t SimSerial::write(uint8_t ch) {
+  if (serial_echo) {
+    fputc(ch, stderr);
+  }
+  return 1;
+}
+
+size_t SimSerial::write(const char* text) {
+  return write((const uint8_t*)text, strlen(text));
+}
+
+size_t SimSerial::write(const uint8_t* buf, size_t len) {
+  if (serial_echo) {
+    fwrite(buf, 1, len, stderr);
+  }
+  return len;
+}
+
+size_t SimSerial::print(const char* text) {
+  return write(text);
+}
+
+size_t SimSerial::print(long v, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%ld", v);
+  return write(buf);
+}
+
+size_t SimSerial::println(const char* text) {
+  return write(text) + write('\n');
+}
+
+size_t SimSerial::println(long v, int base) {
+  return print(v, base) + write('\n');
+}
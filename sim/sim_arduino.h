@@ -0,0 +1,24 @@
+// sim_arduino.h
+//
+// Simulator side of the Arduino shim: virtual clock, pin trace hook and
+// interrupt injection.
+
+#ifndef SIM_ARDUINO_SIM_H
+#define SIM_ARDUINO_SIM_H
+
+#include <stdint.h>
+
+typedef void (*SimPinHook)(uint8_t pin, uint8_t level, uint64_t t_us);
+
+uint64_t sim_now_us();
+void sim_advance(uint64_t us);
+
+void sim_set_pin_hook(SimPinHook hook);
+uint8_t sim_pin_level(uint8_t pin);
+
+// Drive an input pin and run its attached interrupt if the edge matches.
+void sim_drive_pin(uint8_t pin, uint8_t level);
+
+void sim_serial_echo(bool on);
+
+#endif  // SIM_ARDUINO_SIM_H
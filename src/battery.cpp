@@ -0,0 +1,82 @@
+// battery.cpp
+
+#include "battery.h"
+
+// Resting LiPo voltage against state of charge, highest first.
+struct SocPoint {
+  uint16_t mv;
+  uint8_t percent;
+};
+
+static const SocPoint soc_curve[] = {
+    {4200, 100}, {4060, 90}, {3980, 80}, {3920, 70}, {3870, 60}, {3820, 50},
+    {3790, 40},  {3770, 30}, {3730, 20}, {3690, 10}, {3610, 5},  {3300, 0},
+};
+
+void battery_init(Battery& battery) {
+  battery.filtered = 0;
+  battery.mv = 0;
+  battery.scale = 1000;
+  battery.samples = 0;
+}
+
+uint16_t battery_raw_to_mv(int16_t raw) {
+  if (raw < 0) {
+    raw = 0;  // single ended inputs can read slightly negative
+  }
+  uint32_t adc_mv = (uint32_t)raw * BATTERY_ADC_FULL_MV >> BATTERY_ADC_BITS;
+  return adc_mv * BATTERY_DIVIDER_NUM / BATTERY_DIVIDER_DEN;
+}
+
+// Limiter scale for a voltage, rounded down to a whole BATTERY_SCALE_STEP.
+static uint16_t scale_for(uint16_t mv) {
+  if (mv >= BATTERY_LIMIT_HI_MV) {
+    return 1000;
+  }
+  if (mv <= BATTERY_LIMIT_LO_MV) {
+    return BATTERY_SCALE_MIN;
+  }
+  uint32_t scale = BATTERY_SCALE_MIN + (uint32_t)(1000 - BATTERY_SCALE_MIN) *
+                                           (mv - BATTERY_LIMIT_LO_MV) /
+                                           (BATTERY_LIMIT_HI_MV - BATTERY_LIMIT_LO_MV);
+  return scale / BATTERY_SCALE_STEP * BATTERY_SCALE_STEP;
+}
+
+bool battery_update(Battery& battery, uint16_t sample_mv) {
+  if (battery.samples++ == 0) {
+    battery.filtered = (uint32_t)sample_mv << BATTERY_FILTER_SHIFT;
+  } else {
+    battery.filtered += sample_mv - (battery.filtered >> BATTERY_FILTER_SHIFT);
+  }
+  battery.mv = battery.filtered >> BATTERY_FILTER_SHIFT;
+
+  // Drop as soon as the voltage says so, but only give speed back once the
+  // pack has recovered by the hysteresis margin.
+  uint16_t scale = scale_for(battery.mv);
+  if (scale > battery.scale) {
+    scale = scale_for(battery.mv - BATTERY_HYSTERESIS_MV);
+    if (scale < battery.scale) {
+      scale = battery.scale;
+    }
+  }
+  if (scale == battery.scale) {
+    return false;
+  }
+  battery.scale = scale;
+  return true;
+}
+
+uint8_t battery_percent(uint16_t mv) {
+  const uint8_t n = sizeof(soc_curve) / sizeof(soc_curve[0]);
+  if (mv >= soc_curve[0].mv) {
+    return 100;
+  }
+  for (uint8_t i = 1; i < n; i++) {
+    const SocPoint& hi = soc_curve[i - 1];
+    const SocPoint& lo = soc_curve[i];
+    if (mv >= lo.mv) {
+      return lo.percent + (uint32_t)(hi.percent - lo.percent) * (mv - lo.mv) / (hi.mv - lo.mv);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+// battery.h
+//
+// Battery voltage filtering and the power-aware motion limiter.  Samples come
+// from the SAADC in the background (battery_nrf52.cpp) or from a synthetic
+// trace in the simulator; everything here is plain integer C++.
+//
+// As the pack sags the limiter scales maximum speed and acceleration down
+// linearly between BATTERY_LIMIT_HI_MV and BATTERY_LIMIT_LO_MV, so hard moves
+// stop pulling the rail into brownout.  The scale moves in coarse steps with
+// hysteresis so the motion layer is not retuned on every sample.
+
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <stdint.h>
+
+// Xiao nRF52840: VBAT through 1M / 510k to AIN7, 0.6 V reference, gain 1/6.
+#define BATTERY_ADC_FULL_MV 3600
+#define BATTERY_ADC_BITS 12
+#define BATTERY_DIVIDER_NUM 1510
+#define BATTERY_DIVIDER_DEN 510
+
+#define BATTERY_FILTER_SHIFT 3      // IIR weight 1/8 per sample
+#define BATTERY_LIMIT_HI_MV 3700    // full speed above this
+#define BATTERY_LIMIT_LO_MV 3400    // BATTERY_SCALE_MIN below this
+#define BATTERY_SCALE_MIN 400       // permille
+#define BATTERY_SCALE_STEP 50       // permille
+#define BATTERY_HYSTERESIS_MV 30
+
+struct Battery {
+  uint32_t filtered;  // mV << BATTERY_FILTER_SHIFT, 0 until the first sample
+  uint16_t mv;        // filtered voltage
+  uint16_t scale;     // speed and acceleration limit, permille
+  uint32_t samples;
+};
+
+void battery_init(Battery& battery);
+
+/** @return pack voltage in mV for a raw 12-bit SAADC result */
+uint16_t battery_raw_to_mv(int16_t raw);
+
+/**
+ * Filter one sample and update the limiter.
+ * @return true if scale changed
+ */
+bool battery_update(Battery& battery, uint16_t sample_mv);
+
+/** @return state of charge estimate for a resting LiPo, 0..100 */
+uint8_t battery_percent(uint16_t mv);
+
+#ifdef NRF52_SERIES
+// Sample VBAT with 16x oversampling at 8 Hz: RTC2 TICK -> PPI -> SAADC SAMPLE,
+// SAADC END -> PPI -> START re-arms the buffer, so no CPU is needed per
+// sample.  Call after Bluefruit.begin(), PPI goes through the SoftDevice.
+void battery_nrf52_begin();
+
+/**
+ * Mean of the samples that arrived since the last call.
+ * @return false if there were none
+ */
+bool battery_nrf52_read(int16_t& raw);
+#endif
+
+#endif  // BATTERY_H
@@ -0,0 +1,85 @@
+// battery_nrf52.cpp
+//
+// Background VBAT sampling on the Xiao nRF52840.  RTC2 ticks at 8 Hz and
+// triggers SAADC SAMPLE through PPI; with BURST set one SAMPLE takes all 16
+// oversamples.  SAADC END re-arms the result buffer through a second PPI
+// channel, and its interrupt only copies the result out.  RTC0 belongs to the
+// SoftDevice and RTC1 to FreeRTOS.
+
+#ifdef NRF52_SERIES
+
+#include <Arduino.h>
+#include <nrf_soc.h>
+
+#include "battery.h"
+
+#define BATTERY_RTC NRF_RTC2
+#define BATTERY_RTC_PRESCALER 4095   // 32768 Hz / 4096 = 8 Hz
+#define BATTERY_AIN SAADC_CH_PSELP_PSELP_AnalogInput7  // P0.31
+#define BATTERY_ENABLE_PIN 14        // P0.14 low connects the divider
+#define BATTERY_PPI_SAMPLE 8
+#define BATTERY_PPI_START 9
+#define BATTERY_IRQ_PRIORITY 7
+
+static volatile int16_t result;
+static volatile int32_t sum;
+static volatile uint16_t count;
+
+void battery_nrf52_begin() {
+  NRF_P0->DIRSET = 1UL << BATTERY_ENABLE_PIN;
+  NRF_P0->OUTCLR = 1UL << BATTERY_ENABLE_PIN;
+
+  NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Disabled;
+  NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;
+  NRF_SAADC->OVERSAMPLE = SAADC_OVERSAMPLE_OVERSAMPLE_Over16x;
+  NRF_SAADC->CH[0].PSELP = BATTERY_AIN;
+  NRF_SAADC->CH[0].PSELN = SAADC_CH_PSELN_PSELN_NC;
+  NRF_SAADC->CH[0].CONFIG = (SAADC_CH_CONFIG_GAIN_Gain1_6 << SAADC_CH_CONFIG_GAIN_Pos) |
+                            (SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) |
+                            (SAADC_CH_CONFIG_TACQ_40us << SAADC_CH_CONFIG_TACQ_Pos) |
+                            (SAADC_CH_CONFIG_BURST_Enabled << SAADC_CH_CONFIG_BURST_Pos);
+  NRF_SAADC->RESULT.PTR = (uint32_t)&result;
+  NRF_SAADC->RESULT.MAXCNT = 1;
+  NRF_SAADC->EVENTS_END = 0;
+  NRF_SAADC->INTENSET = SAADC_INTENSET_END_Msk;
+  NVIC_SetPriority(SAADC_IRQn, BATTERY_IRQ_PRIORITY);
+  NVIC_ClearPendingIRQ(SAADC_IRQn);
+  NVIC_EnableIRQ(SAADC_IRQn);
+  NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled;
+  NRF_SAADC->TASKS_START = 1;
+
+  BATTERY_RTC->TASKS_STOP = 1;
+  BATTERY_RTC->PRESCALER = BATTERY_RTC_PRESCALER;
+  BATTERY_RTC->EVTENSET = RTC_EVTENSET_TICK_Msk;
+
+  sd_ppi_channel_assign(BATTERY_PPI_SAMPLE, &BATTERY_RTC->EVENTS_TICK,
+                        &NRF_SAADC->TASKS_SAMPLE);
+  sd_ppi_channel_assign(BATTERY_PPI_START, &NRF_SAADC->EVENTS_END, &NRF_SAADC->TASKS_START);
+  sd_ppi_channel_enable_set((1UL << BATTERY_PPI_SAMPLE) | (1UL << BATTERY_PPI_START));
+
+  BATTERY_RTC->TASKS_START = 1;
+}
+
+bool battery_nrf52_read(int16_t& raw) {
+  NVIC_DisableIRQ(SAADC_IRQn);
+  int32_t total = sum;
+  uint16_t n = count;
+  sum = 0;
+  count = 0;
+  NVIC_EnableIRQ(SAADC_IRQn);
+  if (n == 0) {
+    return false;
+  }
+  raw = total / n;
+  return true;
+}
+
+extern "C" void SAADC_IRQHandler(void) {
+  if (NRF_SAADC->EVENTS_END) {
+    NRF_SAADC->EVENTS_END = 0;
+    sum += result;
+    count++;
+  }
+}
+
+#endif  // NRF52_SERIES
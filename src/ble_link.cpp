@@ -0,0 +1,50 @@
+// ble_link.cpp
+
+#include "ble_link.h"
+
+#include <string.h>
+
+void link_init(LinkPolicy& link) {
+  memset(&link, 0, sizeof(link));
+}
+
+void link_rx(LinkPolicy& link, size_t bytes, uint32_t now_us) {
+  LinkModeStats& stats = link.stats[link.mode];
+  uint32_t gap = now_us - link.last_rx_us;
+  if (gap < LINK_BURST_GAP_US) {
+    stats.busy_us += gap;
+  }
+  stats.rx_bytes += bytes;
+  link.last_rx_us = now_us;
+
+  if (link.mode != LINK_ACTIVE) {
+    link.mode = LINK_ACTIVE;
+    link.pending = true;
+  }
+}
+
+void link_reply(LinkPolicy& link, uint32_t now_us) {
+  LinkModeStats& stats = link.stats[link.mode];
+  uint32_t turnaround = now_us - link.last_rx_us;
+  stats.replies++;
+  if (turnaround > stats.turnaround_max_us) {
+    stats.turnaround_max_us = turnaround;
+  }
+}
+
+uint32_t link_throughput(const LinkPolicy& link, LinkMode mode) {
+  const LinkModeStats& stats = link.stats[mode];
+  if (stats.busy_us == 0) {
+    return 0;
+  }
+  return (uint64_t)stats.rx_bytes * 1000000ULL / stats.busy_us;
+}
+
+bool link_select(LinkPolicy& link, uint32_t now_us) {
+  if (link.mode == LINK_ACTIVE && now_us - link.last_rx_us > LINK_IDLE_AFTER_US) {
+    link.mode = LINK_IDLE;
+    link.pending = true;
+    return true;
+  }
+  return false;
+}
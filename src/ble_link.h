@@ -0,0 +1,116 @@
+// ble_link.h
+//
+// Connection policy for the BLE link.  While the client is streaming (jog
+// setpoints, uploads) we ask for a 7.5-15 ms connection interval; after a few
+// seconds without traffic we relax to 100-120 ms with some slave latency to
+// save power.  Both are sent as ranges, iOS refuses a request with min = max.
+// 2M PHY, data length extension and a large MTU are requested once on
+// connect, the central decides what it actually grants.
+//
+// The policy is templated on the connection type so it runs unchanged against
+// a mock on the host; on the device it is LinkConnection, a BLEConnection with
+// range requests.  Each connected peer has its own (see peers.h).
+
+#ifndef BLE_LINK_H
+#define BLE_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Connection intervals are in 1.25 ms units, supervision timeout in 10 ms.
+#define LINK_ACTIVE_INTERVAL_MIN 6   // 7.5 ms
+#define LINK_ACTIVE_INTERVAL_MAX 12  // 15 ms
+#define LINK_ACTIVE_LATENCY 0
+#define LINK_IDLE_INTERVAL_MIN 80    // 100 ms
+#define LINK_IDLE_INTERVAL_MAX 96    // 120 ms
+#define LINK_IDLE_LATENCY 4
+#define LINK_SUP_TIMEOUT 400      // 4 s
+#define LINK_IDLE_AFTER_US 3000000
+#define LINK_SETTLE_US 1000000    // no idle request while the central discovers services
+#define LINK_BURST_GAP_US 100000  // rx gaps longer than this end a burst
+#define LINK_MTU 247
+#define LINK_PHY_2M 0x02          // BLE_GAP_PHY_2MBPS
+
+enum LinkMode {
+  LINK_IDLE,
+  LINK_ACTIVE,
+  LINK_MODES,
+};
+
+struct LinkModeStats {
+  uint32_t rx_bytes;
+  uint32_t busy_us;        // time spent inside rx bursts
+  uint32_t replies;
+  uint32_t turnaround_max_us;  // rx to reply queued
+};
+
+struct LinkPolicy {
+  LinkMode mode;
+  bool pending;            // mode changed, parameters not yet requested
+  uint32_t connected_us;
+  uint32_t last_rx_us;
+  LinkModeStats stats[LINK_MODES];
+};
+
+void link_init(LinkPolicy& link);
+void link_rx(LinkPolicy& link, size_t bytes, uint32_t now_us);
+void link_reply(LinkPolicy& link, uint32_t now_us);
+
+// Bytes per second while data was flowing in the given mode.
+uint32_t link_throughput(const LinkPolicy& link, LinkMode mode);
+
+// Decide the mode for now_us, true if it changed.
+bool link_select(LinkPolicy& link, uint32_t now_us);
+
+template <class Conn>
+void link_connected(LinkPolicy& link, Conn& conn, uint32_t now_us) {
+  link.mode = LINK_IDLE;
+  link.connected_us = now_us;
+  link.last_rx_us = now_us;
+  link.pending = true;
+  conn.requestPHY(LINK_PHY_2M);
+  conn.requestDataLengthUpdate();
+  conn.requestMtuExchange(LINK_MTU);
+}
+
+template <class Conn>
+void link_update(LinkPolicy& link, Conn& conn, uint32_t now_us) {
+  link_select(link, now_us);
+  if (!link.pending) {
+    return;
+  }
+  // The central is still discovering services just after connecting, and a
+  // long interval would drag that out.  Traffic asks for a short one at once.
+  if (link.mode == LINK_IDLE && now_us - link.connected_us < LINK_SETTLE_US) {
+    return;
+  }
+  bool ok = link.mode == LINK_ACTIVE
+                ? conn.requestConnectionParameters(LINK_ACTIVE_INTERVAL_MIN,
+                                                   LINK_ACTIVE_INTERVAL_MAX,
+                                                   LINK_ACTIVE_LATENCY, LINK_SUP_TIMEOUT)
+                : conn.requestConnectionParameters(LINK_IDLE_INTERVAL_MIN, LINK_IDLE_INTERVAL_MAX,
+                                                   LINK_IDLE_LATENCY, LINK_SUP_TIMEOUT);
+  // Retry on the next update if the stack was busy.
+  link.pending = !ok;
+}
+
+#ifdef ARDUINO
+#include <bluefruit.h>
+
+// BLEConnection::requestConnectionParameter() sends min = max, so the
+// interval range goes to the SoftDevice directly.
+struct LinkConnection {
+  BLEConnection& conn;
+
+  bool requestPHY(uint8_t phy) { return conn.requestPHY(phy); }
+  bool requestDataLengthUpdate() { return conn.requestDataLengthUpdate(); }
+  bool requestMtuExchange(uint16_t mtu) { return conn.requestMtuExchange(mtu); }
+  bool requestConnectionParameters(uint16_t min_interval, uint16_t max_interval, uint16_t latency,
+                                   uint16_t timeout) {
+    ble_gap_conn_params_t params = {min_interval, max_interval, latency, timeout};
+    return sd_ble_gap_conn_param_update(conn.handle(), &params) == NRF_SUCCESS;
+  }
+};
+#endif
+
+#endif  // BLE_LINK_H
@@ -26,6 +26,15 @@ Can add an app front end, and set up UART control.
 #include <Adafruit_LittleFS.h>
 #include <InternalFileSystem.h>
 #include <motors.h>
+#include <commands.h>
+#include <ble_link.h>
+#include <peers.h>
+#include <tasks.h>
+#include <battery.h>
+#include <event_log.h>
+#include <boot.h>
+#include <config.h>
+#include <wear.h>
 
 
 // BLE Service
@@ -34,20 +43,27 @@ BLEDis  bledis;  // device information
 BLEUart bleuart; // uart over ble
 BLEBas  blebas;  // battery
 
+Battery battery;
+uint8_t battery_level = 100;
+
 
 void setup()
 {
+  // Doesn't block; output before the host opens the port is dropped
   Serial.begin(115200);
   pinMode(LED_GREEN, OUTPUT);
 
+  // Motion hardware first: outputs safe, limit switches armed
   setup_steppers();
+  motion_set_limit_hook(log_limit);
+  boot_mark(BOOT_MOTION, micros());
 
+  if (config_load(motion_config)) {
+    motion_configure(motion_config);
+  }
+  wear_begin(wear, micros());
+  boot_mark(BOOT_CONFIG, micros());
 
-#if CFG_DEBUG
-  // Blocking wait for connection when debug mode is enabled via IDE
-  while ( !Serial ) yield();
-#endif
-  
   Serial.println("Camera Slider");
   Serial.println("---------------------------\n");
 
@@ -60,15 +76,19 @@ void setup()
   // more SRAM required by SoftDevice
   // Note: All config***() function must be called before begin()
   Bluefruit.configPrphBandwidth(BANDWIDTH_MAX);
+  peers_init(ble_peers);
 
-  Bluefruit.begin();
+  // Up to PEER_MAX centrals at once, e.g. the app and a remote
+  Bluefruit.begin(PEER_MAX, 0);
   Bluefruit.setTxPower(4);    // Check bluefruit.h for supported values
   //Bluefruit.setName(getMcuUniqueID()); // useful testing with multiple central connections
   Bluefruit.Periph.setConnectCallback(connect_callback);
   Bluefruit.Periph.setDisconnectCallback(disconnect_callback);
   Bluefruit.setName("Camera Slider");
+  boot_mark(BOOT_BLE, micros());
 
-  // To be consistent OTA DFU should be added first if it exists
+  // Every GATT service goes in before advertising, so a central never sees
+  // the table change.  DFU first, as centrals cache handles for bonded devices.
   bledfu.begin();
 
   // Configure and Start Device Information Service
@@ -76,16 +96,26 @@ void setup()
   bledis.setModel("Bluefruit Feather52");
   bledis.begin();
 
-  // Configure and Start BLE Uart Service
   bleuart.begin();
+  bleuart.setRxCallback(ble_rx_callback);
 
   // Start BLE Battery Service
   blebas.begin();
-  blebas.write(100);
+  blebas.write(battery_level);
+  boot_mark(BOOT_SERVICES, micros());
+
+  battery_init(battery);
+  tasks_begin(command_poll, ble_reply, telemetry_poll);
+  boot_mark(BOOT_READY, micros());
 
-  // Set up and start advertising
   startAdv();
+  boot_mark(BOOT_ADVERTISING, micros());
+
+  // Only battery sampling is left for after advertising; the telemetry task
+  // skips its readings until the first one lands.
+  battery_nrf52_begin();
 
+  digitalToggle(LED_RED);  // boot indicator off
   Serial.println("Please use Adafruit's Bluefruit LE app to connect in UART mode");
   Serial.println("Once connected, enter character(s) that you wish to send");
 }
@@ -120,7 +150,14 @@ void startAdv(void)
 
 void loop()
 {
-  // Forward data from HW Serial to BLEUART
+  // Everything runs in the tasks started by setup()
+  suspendLoop();
+}
+
+// Command task: BLE and Serial traffic
+void command_poll()
+{
+  // Forward data from HW Serial to every BLE peer
   while (Serial.available())
   {
     // Delay to wait for enough input, since we have a limited transmission buffer
@@ -128,30 +165,89 @@ void loop()
 
     uint8_t buf[64];
     int count = Serial.readBytes(buf, sizeof(buf));
-    bleuart.write( buf, count );
+    evlog_input(event_log, EVLOG_SERIAL, buf, count, micros());
+    for (uint8_t id = 0; id < PEER_MAX; id++) {
+      peers_write(ble_peers, id, buf, count);
+    }
   }
 
-  // Forward from BLEUART to HW Serial
-  while ( bleuart.available() )
+  // Run the lines each peer sent; status to the watchers
+  peers_poll(ble_peers, micros());
+  peers_telemetry(ble_peers, micros());
+
+  // Event log goes to flash while nothing is moving
+  evlog_poll(event_log, !motion_busy(), micros());
+
+  // Short connection interval while a client is streaming, relaxed when idle,
+  // and replies split to each connection's MTU
+  for (uint8_t id = 0; id < PEER_MAX; id++)
   {
-    uint8_t ch;
-    ch = (uint8_t) bleuart.read();
-
-    if ( ch == 'a'){
-      Serial.write("a intercept - change dir");
-      digitalToggle(LED_GREEN);
-      slide_dist(50);
-    } else if (ch == 'b' ) {
-      Serial.write("b intercept - change dir");
-      digitalToggle(LED_GREEN);
-      slide_dist(-50);
-    } else {
-      Serial.write(ch);
+    Peer& peer = ble_peers.peer[id];
+    BLEConnection* connection = peer.connected ? Bluefruit.Connection(peer.conn) : NULL;
+    if ( connection )
+    {
+      LinkConnection link_conn = {*connection};
+      link_update(peer.link, link_conn, micros());
+      peers_set_chunk(ble_peers, id, connection->getMtu() - 3);
     }
   }
+  peers_send(ble_peers, ble_send);
+}
 
-  // slider_stepper.run();
-  run_or_off();
+// Telemetry task: battery level out to BLEBas and the status reply, and the
+// speed limit into the motion task
+void telemetry_poll()
+{
+  int16_t raw;
+  if (!battery_nrf52_read(raw)) {
+    return;
+  }
+  if (battery_update(battery, battery_raw_to_mv(raw))) {
+    motion_set_power_scale(battery.scale);
+  }
+  uint8_t level = battery_percent(battery.mv);
+  command_set_battery(level, battery.mv);
+  if (level != battery_level) {
+    battery_level = level;
+    blebas.notify(battery_level);
+  }
+}
+
+// Limit switch interrupt, into the event log
+void log_limit(uint8_t pin)
+{
+  evlog_limit(event_log, pin, micros());
+}
+
+// BLE UART data arrived, runs in the BLE task.  The UART service has one
+// FIFO for all connections, so it is emptied here into the sender's ring.
+void ble_rx_callback(uint16_t conn_handle)
+{
+  uint8_t id = peers_find(ble_peers, conn_handle);
+  while ( bleuart.available() )
+  {
+    uint8_t buf[64];
+    int count = bleuart.read(buf, sizeof(buf));
+    peers_rx(ble_peers, id, buf, count);
+  }
+  tasks_rx_notify();
+}
+
+// command responses go to the TX ring of the peer that sent the command
+void ble_reply(uint8_t source, const uint8_t* buf, size_t len)
+{
+  if (source >= PEER_MAX) {
+    Serial.write(buf, len);
+    return;
+  }
+  peers_write(ble_peers, source, buf, len);
+  link_reply(ble_peers.peer[source].link, micros());
+}
+
+// one notification to one connection
+size_t ble_send(uint16_t conn, const uint8_t* buf, size_t len)
+{
+  return bleuart.write(conn, buf, len);
 }
 
 // callback invoked when central connects
@@ -163,8 +259,25 @@ void connect_callback(uint16_t conn_handle)
   char central_name[32] = { 0 };
   connection->getPeerName(central_name, sizeof(central_name));
 
+  uint8_t id = peers_connect(ble_peers, conn_handle, micros());
+  if (id == PEER_NONE) {
+    connection->disconnect();
+    return;
+  }
   Serial.print("Connected to ");
-  Serial.println(central_name);
+  Serial.print(central_name);
+  Serial.print(" as peer ");
+  Serial.println(id);
+
+  // Ask for 2M PHY, DLE and a large MTU, the central grants what it supports
+  boot_mark(BOOT_CONNECT, micros());
+  LinkConnection link_conn = {*connection};
+  link_connected(ble_peers.peer[id].link, link_conn, micros());
+
+  // Keep advertising until every slot is taken
+  if (peers_count(ble_peers) < PEER_MAX) {
+    Bluefruit.Advertising.start(0);
+  }
 }
 
 /**
@@ -174,9 +287,10 @@ void connect_callback(uint16_t conn_handle)
  */
 void disconnect_callback(uint16_t conn_handle, uint8_t reason)
 {
-  (void) conn_handle;
   (void) reason;
 
+  peers_disconnect(ble_peers, conn_handle, micros());
+
   Serial.println();
   Serial.print("Disconnected, reason = 0x"); Serial.println(reason, HEX);
 }
@@ -0,0 +1,32 @@
+// boot.cpp
+
+#include "boot.h"
+
+static uint32_t phase_us[BOOT_PHASES];
+static uint16_t marked;
+
+void boot_mark(BootPhase phase, uint32_t now_us) {
+  if (marked & (1u << phase)) {
+    return;
+  }
+  phase_us[phase] = now_us;
+  marked |= 1u << phase;
+}
+
+void boot_report(RespWriter& w) {
+  static const char* const names[BOOT_PHASES] = {"motion", "config",      "ble",     "services",
+                                                 "ready",  "advertising", "connect", "first move"};
+  resp_str(w, "boot");
+  for (uint8_t phase = 0; phase < BOOT_PHASES; phase++) {
+    resp_str(w, phase ? ", " : " ");
+    resp_str(w, names[phase]);
+    resp_char(w, ' ');
+    if (marked & (1u << phase)) {
+      resp_uint(w, phase_us[phase]);
+      resp_str(w, " us");
+    } else {
+      resp_char(w, '-');
+    }
+  }
+  resp_char(w, '\n');
+}
@@ -0,0 +1,32 @@
+// boot.h
+//
+// Boot phase timestamps, so time-to-advertising and time-to-first-move can be
+// watched as the firmware grows.  Times are micros() since reset; only the
+// first mark of each phase counts.
+
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+
+#include "resp_writer.h"
+
+enum BootPhase {
+  BOOT_MOTION,       // pins safe, limits armed, steppers configured
+  BOOT_CONFIG,       // persisted config applied
+  BOOT_BLE,          // SoftDevice up
+  BOOT_SERVICES,     // DFU, DIS, UART, battery up
+  BOOT_READY,        // tasks running, commands accepted
+  BOOT_ADVERTISING,  // advertising started
+  BOOT_CONNECT,      // first central connected
+  BOOT_FIRST_MOVE,   // first time a motor moved
+  BOOT_PHASES
+};
+
+void boot_mark(BootPhase phase, uint32_t now_us);
+
+// "boot <phase> <us> us, ..." with '-' for phases not reached yet.  The
+// command is "startup?", a line starting with 'b' would be a legacy nudge.
+void boot_report(RespWriter& w);
+
+#endif  // BOOT_H
@@ -0,0 +1,129 @@
+// clock_sync.cpp
+
+#include "clock_sync.h"
+
+#include <math.h>
+#include <string.h>
+
+void sync_init(ClockSync& sync) {
+  memset(&sync, 0, sizeof(sync));
+}
+
+// Skew: a line through the quick samples of the whole window, taken once its
+// standard error is small enough.  Offset: the quickest of the last
+// SYNC_OFFSET_SAMPLES samples, the one least delayed waiting for a connection
+// event, carried forward along the skew by sync_to_local().
+static void sync_fit(ClockSync& sync) {
+  uint32_t best = 0xffffffffu;
+  for (uint8_t i = 0; i < sync.count; i++) {
+    if (sync.sample[i].delay_us < best) {
+      best = sync.sample[i].delay_us;
+    }
+  }
+  uint32_t limit = best + SYNC_DELAY_SLACK_US;
+  const SyncSample& newest = sync.sample[(sync.next + SYNC_SAMPLES - 1) % SYNC_SAMPLES];
+
+  // Positions relative to the newest sample: x local time, y offset.
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  uint8_t used = 0;
+  for (uint8_t i = 0; i < sync.count; i++) {
+    const SyncSample& s = sync.sample[i];
+    if (s.delay_us > limit) {
+      continue;
+    }
+    double x = (int32_t)(s.local_us - newest.local_us);
+    double y = (int32_t)(s.offset_us - newest.offset_us);
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+    used++;
+  }
+  if (used >= SYNC_SKEW_MIN_SAMPLES) {
+    double var = sxx - sx * sx / used;
+    double slope = (sxy - sx * sy / used) / var;
+    double intercept = (sy - slope * sx) / used;
+    // Standard error of the slope from the scatter about the line.
+    double res = 0;
+    for (uint8_t i = 0; i < sync.count; i++) {
+      const SyncSample& s = sync.sample[i];
+      if (s.delay_us <= limit) {
+        double x = (int32_t)(s.local_us - newest.local_us);
+        double r = (int32_t)(s.offset_us - newest.offset_us) - intercept - slope * x;
+        res += r * r;
+      }
+    }
+    if (var > 0 && sqrt(res / (used - 2) / var) * 1e9 < SYNC_SKEW_SE_PPB) {
+      sync.skew_ppb = (int32_t)lround(slope * 1e9);
+    }
+  }
+
+  const SyncSample* quick = &newest;
+  for (uint8_t n = 2; n <= sync.count && n <= SYNC_OFFSET_SAMPLES; n++) {
+    const SyncSample& s = sync.sample[(sync.next + SYNC_SAMPLES - n) % SYNC_SAMPLES];
+    if (s.delay_us < quick->delay_us) {
+      quick = &s;
+    }
+  }
+  sync.ref_us = quick->local_us;
+  sync.offset_us = quick->offset_us;
+  sync.delay_us = best;
+  sync.used = used;
+}
+
+bool sync_add(ClockSync& sync, uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4) {
+  int32_t delay = (int32_t)((t4 - t1) - (t3 - t2));
+  if (delay < 0) {
+    sync.rejected++;
+    return false;
+  }
+  // Both legs give local - central, each off by its own transit time; their
+  // mean cancels a symmetric delay.  Kept in wrapping arithmetic.
+  uint32_t out = t2 - t1;
+  uint32_t back = t3 - t4;
+  uint32_t local = t2 + (t3 - t2) / 2;
+  sync.exchanges++;
+
+  // One sample per bucket, the quickest exchange in it.
+  if (sync.count && local - sync.bucket_us < SYNC_BUCKET_US) {
+    uint8_t last = (sync.next + SYNC_SAMPLES - 1) % SYNC_SAMPLES;
+    if ((uint32_t)delay >= sync.sample[last].delay_us) {
+      return true;
+    }
+    sync.next = last;
+    sync.count--;
+  } else {
+    sync.bucket_us = local;
+  }
+  SyncSample& s = sync.sample[sync.next];
+  s.offset_us = out + (int32_t)(back - out) / 2;
+  s.local_us = local;
+  s.delay_us = delay;
+  sync.next = (sync.next + 1) % SYNC_SAMPLES;
+  if (sync.count < SYNC_SAMPLES) {
+    sync.count++;
+  }
+  sync_fit(sync);
+  sync.synced = true;
+  return true;
+}
+
+uint32_t sync_to_local(const ClockSync& sync, uint32_t central_us) {
+  if (!sync.synced) {
+    return central_us;
+  }
+  int32_t d = (int32_t)(central_us - (sync.ref_us - sync.offset_us));
+  return sync.ref_us + d + (int32_t)((int64_t)d * sync.skew_ppb / 1000000000);
+}
+
+uint32_t sync_to_central(const ClockSync& sync, uint32_t local_us) {
+  if (!sync.synced) {
+    return local_us;
+  }
+  int32_t d = (int32_t)(local_us - sync.ref_us);
+  return sync.ref_us - sync.offset_us + d - (int32_t)((int64_t)d * sync.skew_ppb / 1000000000);
+}
+
+uint64_t sync_period_q16(uint32_t period_us, int32_t skew_ppb) {
+  return (uint64_t)((double)period_us * 65536.0 * (1.0 + skew_ppb / 1e9) + 0.5);
+}
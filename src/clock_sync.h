@@ -0,0 +1,72 @@
+// clock_sync.h
+//
+// Clock synchronisation with a central, so that several sliders can start a
+// move at the same moment.  NTP style: the central sends its time t1, the
+// slider stamps the line's arrival t2 and its reply t3, the central stamps
+// the reply's arrival t4 and sends all four back.  Each exchange gives an
+// offset sample ((t2 - t1) + (t3 - t4)) / 2, wrong by at most half the round
+// trip (t4 - t1) - (t3 - t2).  Over BLE the round trip is mostly waiting for
+// connection events.  So only the quickest exchange of each SYNC_BUCKET_US is
+// kept, only those within SYNC_DELAY_SLACK_US of the quickest of all are
+// used, and a line is fitted through them: its value now is the offset, its
+// slope the skew between the two crystals.  The skew is only taken once its
+// standard error is below SYNC_SKEW_SE_PPB, until then it stays at the last
+// good fit (zero at first).
+//
+// Times are microseconds that wrap at 2^32; differences must stay under
+// 2^31 (35 minutes).  No Arduino dependencies.
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+
+#define SYNC_SAMPLES 16
+#define SYNC_BUCKET_US 4000000     // one exchange kept per 4 s, about a minute of history
+#define SYNC_OFFSET_SAMPLES 2      // the offset comes from the last 4-8 s
+#define SYNC_DELAY_SLACK_US 1000   // slower exchanges than best + this are not used
+#define SYNC_SKEW_SE_PPB 3000      // skew fits less certain than 3 ppm are not taken
+#define SYNC_SKEW_MIN_SAMPLES 6
+
+struct SyncSample {
+  uint32_t local_us;   // midway between t2 and t3
+  uint32_t offset_us;  // local - central, mod 2^32
+  uint32_t delay_us;   // round trip less the time the slider held the line
+};
+
+struct ClockSync {
+  SyncSample sample[SYNC_SAMPLES];
+  uint8_t count;
+  uint8_t next;
+  bool synced;
+  uint8_t used;          // exchanges in the last fit
+  uint32_t bucket_us;    // local time the newest sample's bucket started
+  uint32_t ref_us;       // local time the fit is anchored at
+  uint32_t offset_us;    // local - central at ref_us
+  int32_t skew_ppb;      // how much faster the local clock runs than the central's
+  uint32_t delay_us;     // quickest round trip in the window
+  uint32_t exchanges;
+  uint32_t rejected;     // negative round trip, the timestamps do not belong together
+};
+
+void sync_init(ClockSync& sync);
+
+/**
+ * Add one exchange, t1 and t4 on the central's clock, t2 and t3 on ours.
+ * @return false if it was rejected
+ */
+bool sync_add(ClockSync& sync, uint32_t t1, uint32_t t2, uint32_t t3, uint32_t t4);
+
+/** @return local time for a central time, the same time if not synced */
+uint32_t sync_to_local(const ClockSync& sync, uint32_t central_us);
+
+/** @return central time for a local time */
+uint32_t sync_to_central(const ClockSync& sync, uint32_t local_us);
+
+/**
+ * A period on the central's clock measured on ours, in 1/65536 us, so a
+ * stream of them keeps pace with the central.
+ */
+uint64_t sync_period_q16(uint32_t period_us, int32_t skew_ppb);
+
+#endif  // CLOCK_SYNC_H
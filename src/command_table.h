@@ -0,0 +1,186 @@
+// command_table.h
+//
+// Keyword dispatch for the text commands.  A line is split into its keyword
+// (everything before the first digit or '-', e.g. "config:slider:" or "rec?")
+// and its arguments.  The keyword table is a constexpr array, and a perfect
+// hash over it is found at compile time: the seed search, the collision check
+// and the slot table are all constant expressions, so a lookup is one hash of
+// at most COMMAND_KEYWORD_MAX bytes, one slot load and one compare, however
+// many commands there are.
+//
+// C++11 constexpr only (single return statements, recursion), since that is
+// what the nRF52 toolchain builds with.  Numeric arguments are parsed in place,
+// without atoi/strtol.
+
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define COMMAND_KEYWORD_MAX 16
+#define COMMAND_SLOT_BITS 8
+#define COMMAND_SLOTS (1 << COMMAND_SLOT_BITS)
+#define COMMAND_SEED_MAX 4096  // seeds tried before giving up
+
+// CommandEntry flags
+#define COMMAND_ARGS 0x01     // arguments follow, otherwise the keyword is the whole line
+#define COMMAND_CONTROL 0x02  // moves or reconfigures, only for the peer in control
+
+struct CommandEntry {
+  const char* keyword;
+  void (*run)(const char* args);
+  uint8_t flags;
+};
+
+struct CommandSlots {
+  int8_t index[COMMAND_SLOTS];  // table index, or -1 for an empty slot
+};
+
+// FNV-1a with the seed as offset basis; the top bits pick the slot.
+constexpr uint32_t command_hash(const char* s, uint32_t h) {
+  return *s ? command_hash(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h;
+}
+
+static inline uint32_t command_hash(const char* s, size_t len, uint32_t h) {
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (uint8_t)s[i]) * 16777619u;
+  }
+  return h;
+}
+
+constexpr uint8_t command_slot(uint32_t hash) {
+  return hash >> (32 - COMMAND_SLOT_BITS);
+}
+
+// Compile-time side.  Each function recurses over one index, so the depth
+// stays within a few times the table size.
+
+template <size_t N>
+constexpr bool command_slot_unique(const CommandEntry (&table)[N], uint32_t seed, size_t i,
+                                   size_t j) {
+  return j == N || (command_slot(command_hash(table[i].keyword, seed)) !=
+                        command_slot(command_hash(table[j].keyword, seed)) &&
+                    command_slot_unique(table, seed, i, j + 1));
+}
+
+/** @return true if no two keywords share a slot with this seed */
+template <size_t N>
+constexpr bool command_perfect(const CommandEntry (&table)[N], uint32_t seed, size_t i = 0) {
+  return i == N ||
+         (command_slot_unique(table, seed, i, i + 1) && command_perfect(table, seed, i + 1));
+}
+
+template <size_t N>
+constexpr uint32_t command_find_seed(const CommandEntry (&table)[N], uint32_t lo, uint32_t hi);
+
+template <size_t N>
+constexpr uint32_t command_find_seed_or(uint32_t found, const CommandEntry (&table)[N], uint32_t lo,
+                                        uint32_t hi) {
+  return found ? found : command_find_seed(table, lo, hi);
+}
+
+/** @return the lowest perfect seed in [lo, hi), or 0 if there is none */
+template <size_t N>
+constexpr uint32_t command_find_seed(const CommandEntry (&table)[N], uint32_t lo, uint32_t hi) {
+  return hi - lo == 1
+             ? (command_perfect(table, lo) ? lo : 0)
+             : command_find_seed_or(command_find_seed(table, lo, lo + (hi - lo) / 2), table,
+                                    lo + (hi - lo) / 2, hi);
+}
+
+template <size_t N>
+constexpr int8_t command_slot_owner(const CommandEntry (&table)[N], uint32_t seed, uint8_t slot,
+                                    size_t i = 0) {
+  return i == N ? -1
+                : command_slot(command_hash(table[i].keyword, seed)) == slot
+                      ? (int8_t)i
+                      : command_slot_owner(table, seed, slot, i + 1);
+}
+
+// 0, 1, ... COMMAND_SLOTS - 1 as a parameter pack, to fill the slot table.
+template <size_t... S>
+struct CommandSeq {};
+template <size_t N, size_t... S>
+struct CommandMakeSeq : CommandMakeSeq<N - 1, N - 1, S...> {};
+template <size_t... S>
+struct CommandMakeSeq<0, S...> {
+  typedef CommandSeq<S...> type;
+};
+
+template <size_t N, size_t... S>
+constexpr CommandSlots command_slots(const CommandEntry (&table)[N], uint32_t seed,
+                                     CommandSeq<S...>) {
+  return CommandSlots{{command_slot_owner(table, seed, S)...}};
+}
+
+template <size_t N>
+constexpr CommandSlots command_slots(const CommandEntry (&table)[N], uint32_t seed) {
+  return command_slots(table, seed, typename CommandMakeSeq<COMMAND_SLOTS>::type());
+}
+
+// Run time side.
+
+/** @return length of the keyword at the start of line */
+static inline size_t command_keyword_len(const char* line, size_t len) {
+  size_t n = 0;
+  while (n < len && line[n] != '-' && (line[n] < '0' || line[n] > '9')) {
+    n++;
+  }
+  return n;
+}
+
+/** @return the entry for the keyword, or NULL if there is none */
+template <size_t N>
+static inline const CommandEntry* command_lookup(const CommandEntry (&table)[N],
+                                                 const CommandSlots& slots, uint32_t seed,
+                                                 const char* keyword, size_t len) {
+  if (len > COMMAND_KEYWORD_MAX) {
+    return NULL;
+  }
+  int8_t i = slots.index[command_slot(command_hash(keyword, len, seed))];
+  if (i < 0 || strncmp(table[i].keyword, keyword, len) != 0 || table[i].keyword[len] != '\0') {
+    return NULL;
+  }
+  return &table[i];
+}
+
+/**
+ * Parse a decimal integer with optional '-' and step p past it.
+ * @return false if there are no digits or it does not fit in int32_t
+ */
+static inline bool parse_int(const char*& p, int32_t& value) {
+  bool negative = *p == '-';
+  const char* s = p + negative;
+  if (*s < '0' || *s > '9') {
+    return false;
+  }
+  uint32_t v = 0;
+  uint32_t limit = negative ? 0x80000000u : 0x7fffffffu;
+  for (; *s >= '0' && *s <= '9'; s++) {
+    uint32_t digit = *s - '0';
+    if (v > (limit - digit) / 10) {
+      return false;
+    }
+    v = v * 10 + digit;
+  }
+  value = negative ? (int32_t)(0u - v) : (int32_t)v;
+  p = s;
+  return true;
+}
+
+/**
+ * Parse exactly count comma separated integers making up all of args.
+ * @return false on anything else
+ */
+static inline bool parse_ints(const char* args, int32_t* values, uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    if ((i && *args++ != ',') || !parse_int(args, values[i])) {
+      return false;
+    }
+  }
+  return *args == '\0';
+}
+
+#endif  // COMMAND_TABLE_H
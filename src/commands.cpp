@@ -0,0 +1,795 @@
+// commands.cpp
+
+#include "commands.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "ble_link.h"
+#include "boot.h"
+#include "clock_sync.h"
+#include "command_table.h"
+#include "config.h"
+#include "event_log.h"
+#include "motors.h"
+#include "peers.h"
+#include "tasks.h"
+#include "wear.h"
+
+static CommandLine local_line;
+static uint8_t run_source = COMMAND_LOCAL;
+static uint32_t run_rx_us;
+static RespWriter out = {NULL, RESP_CHUNK_DEFAULT, 0, true, 0, {0}};
+static uint8_t battery_percent = 100;
+static uint16_t battery_mv = 0;
+
+static ClockSync clock_sync;
+
+// A line held by "when:" until its time comes.
+struct WhenCommand {
+  bool pending;
+  uint8_t source;
+  uint8_t len;
+  uint32_t due_us;  // our clock
+  char text[COMMAND_LINE_MAX];
+};
+
+static WhenCommand when_commands[WHEN_MAX];
+static volatile uint8_t when_pending;
+static volatile uint32_t when_next_us;  // earliest due_us while any are pending
+static uint32_t when_runs;
+static uint32_t when_late_us;
+static uint32_t when_late_max_us;
+
+// Every reply goes through the writer and ends in a flush, so each one leaves
+// as whole notifications.
+static void reply(const char* text) {
+  resp_str(out, text);
+  resp_flush(out);
+}
+
+void command_set_reply(RespSink sink, uint16_t chunk) {
+  resp_init(out, sink, chunk);
+}
+
+void command_set_chunk(uint16_t chunk) {
+  resp_set_chunk(out, chunk);
+}
+
+void command_set_battery(uint8_t percent, uint16_t mv) {
+  battery_percent = percent;
+  battery_mv = mv;
+}
+
+void command_status(RespWriter& w) {
+  resp_obj_begin(w);
+  resp_field_str(w, "status", motion_busy() ? "moving" : "idle");
+  resp_field_int(w, "position", motion_position(0));
+  resp_field_int(w, "target", motion_target(0));
+  resp_field_int(w, "speed", motion_speed(0));
+  resp_field_int(w, "battery", battery_percent);
+  resp_field_int(w, "vbat", battery_mv);
+  resp_field_int(w, "power", motion_power_scale());
+  resp_obj_end(w);
+  resp_char(w, '\n');
+}
+
+// Reply for commands that only fail when the motors are busy.
+static void reply_done(bool ok) {
+  reply(ok ? "Command received and executed\n" : "Error: Device busy\n");
+}
+
+// Legacy nudges, "a" forward and "b" back
+static void command_nudge_a(const char* args) {
+  (void)args;
+  Serial.write("a intercept - change dir");
+  digitalToggle(LED_GREEN);
+  slide_dist(50);
+}
+
+static void command_nudge_b(const char* args) {
+  (void)args;
+  Serial.write("b intercept - change dir");
+  digitalToggle(LED_GREEN);
+  slide_dist(-50);
+}
+
+// "x" emergency stop.  From a peer the stop was already requested when the
+// byte arrived (peers_rx()); this acknowledges it, lifts the latch and drops
+// anything scheduled with "when:".
+static void command_estop(const char* args) {
+  (void)args;
+  if (command_source() == COMMAND_LOCAL) {
+    motion_estop(micros());
+  }
+  for (uint8_t i = 0; i < WHEN_MAX; i++) {
+    when_commands[i].pending = false;
+  }
+  when_pending = 0;
+  motion_estop_ack();
+  reply("STOP\n");
+}
+
+// "stop?" emergency stop latency
+static void command_stop_report(const char* args) {
+  (void)args;
+  resp_str(out, "stop ");
+  resp_uint(out, estop_count());
+  resp_str(out, " times, latency ");
+  resp_uint(out, estop_latency_us());
+  resp_str(out, " us, max ");
+  resp_uint(out, estop_latency_max_us());
+  reply(" us\n");
+}
+
+// "s" status object
+static void command_s(const char* args) {
+  (void)args;
+  command_status(out);
+  resp_flush(out);
+}
+
+static void command_ping(const char* args) {
+  (void)args;
+  reply("pong\n");
+}
+
+// "tasks?" per task CPU load, resets the window
+static void command_tasks(const char* args) {
+  (void)args;
+  tasks_report(out, micros());
+  resp_flush(out);
+}
+
+// "startup?" boot phase times
+static void command_startup(const char* args) {
+  (void)args;
+  boot_report(out);
+  resp_flush(out);
+}
+
+// "j?" latency report
+static void command_jog_report(const char* args) {
+  (void)args;
+  resp_str(out, "jog latency ");
+  resp_uint(out, jog_latency_us());
+  resp_str(out, " us, max ");
+  resp_uint(out, jog_latency_max_us());
+  reply(" us\n");
+}
+
+// "j:<slider>,<rotator>" in steps/s
+static void command_jog(const char* args) {
+  int32_t v[2];
+  if (!parse_ints(args, v, 2)) {
+    reply("Error: Invalid parameter\n");
+    return;
+  }
+  if (!jog_velocity(v[0], v[1], command_rx_us())) {
+    reply("Error: At limit\n");
+  }
+}
+
+// "rec?" recorder report
+static void command_rec_report(const char* args) {
+  (void)args;
+  resp_str(out, "rec ");
+  resp_uint(out, record_samples());
+  resp_str(out, " samples, ");
+  resp_uint(out, record_bytes());
+  resp_str(out, " B, ");
+  resp_uint(out, record_bytes_per_minute());
+  resp_str(out, " B/min, replay err max ");
+  resp_uint(out, replay_error_max_us());
+  reply(" us\n");
+}
+
+static void command_rec_start(const char* args) {
+  (void)args;
+  record_start();
+  reply_done(true);
+}
+
+static void command_rec_stop(const char* args) {
+  (void)args;
+  record_stop();
+  reply_done(true);
+}
+
+// "rec:play" at full speed or "rec:play:<percent>"
+static void command_rec_play(const char* args) {
+  int32_t percent = 100;
+  if (*args && !parse_ints(args, &percent, 1)) {
+    reply("Error: Invalid parameter\n");
+    return;
+  }
+  reply_done(replay_start(percent));
+}
+
+static void command_rec_save(const char* args) {
+  (void)args;
+  reply_done(record_save());
+}
+
+static void command_rec_load(const char* args) {
+  (void)args;
+  reply_done(record_load());
+}
+
+// "key:<pos>,<angle>,<ms>" appends a spline keyframe
+static void command_key(const char* args) {
+  int32_t v[3];
+  reply(parse_ints(args, v, 3) && v[2] >= 0 && path_key(v[0], v[1], v[2])
+            ? "Command received and executed\n"
+            : "Error: Invalid parameter\n");
+}
+
+// "cruise:<slider>,<rotator>" in milli-steps/s, "cruise:0,0" stops
+static void command_cruise(const char* args) {
+  int32_t v[2];
+  reply(parse_ints(args, v, 2) && cruise_start(v[0], v[1]) ? "Command received and executed\n"
+                                                           : "Error: Invalid parameter\n");
+}
+
+// "table?" step table report
+static void command_table_report(const char* args) {
+  (void)args;
+  resp_str(out, "table ");
+  resp_uint(out, table_bytes());
+  resp_str(out, " B, steps ");
+  resp_uint(out, table_steps(0));
+  resp_char(out, '/');
+  resp_uint(out, table_steps(1));
+  resp_str(out, ", underruns ");
+  resp_uint(out, table_underruns());
+  reply("\n");
+}
+
+// "table:compile:<slider>,<rotator>"
+static void command_table_compile(const char* args) {
+  int32_t v[2];
+  reply_done(parse_ints(args, v, 2) && table_compile(v[0], v[1]));
+}
+
+static void command_table_save(const char* args) {
+  (void)args;
+  reply_done(table_save());
+}
+
+static void command_table_run(const char* args) {
+  (void)args;
+  reply_done(table_run());
+}
+
+static void command_path_run(const char* args) {
+  (void)args;
+  reply_done(path_run());
+}
+
+static void command_path_clear(const char* args) {
+  (void)args;
+  path_clear();
+  reply_done(true);
+}
+
+// "config?" current limits
+static void command_config_report(const char* args) {
+  static const char* const names[2] = {"slider", "rotator"};
+  (void)args;
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    resp_str(out, axis ? ", " : "config ");
+    resp_str(out, names[axis]);
+    resp_char(out, ' ');
+    resp_uint(out, motion_config.max_speed[axis]);
+    resp_str(out, " steps/s, accel ");
+    resp_uint(out, motion_config.accel[axis]);
+    resp_str(out, ", jog accel ");
+    resp_uint(out, motion_config.jog_accel[axis]);
+  }
+  reply("\n");
+}
+
+// Apply config to the motors and keep it if they took it.
+static void config_apply(const MotionConfig& config, const char* done) {
+  bool ok = motion_configure(config);
+  if (ok) {
+    motion_config = config;
+  }
+  reply(ok ? done : "Error: Device busy\n");
+}
+
+static void command_config_save(const char* args) {
+  (void)args;
+  reply(!motion_busy() && config_save(motion_config) ? "Settings saved\n"
+                                                     : "Error: Device busy\n");
+}
+
+static void command_config_load(const char* args) {
+  (void)args;
+  MotionConfig config;
+  if (!config_load(config)) {
+    reply("Error: No saved settings\n");
+    return;
+  }
+  config_apply(config, "Settings loaded\n");
+}
+
+static void command_config_reset(const char* args) {
+  (void)args;
+  MotionConfig config;
+  config_defaults(config);
+  config_apply(config, "Defaults restored\n");
+}
+
+// "config:slider:<speed>,<accel>" and "config:rotator:<speed>,<accel>"
+static void config_axis(uint8_t axis, const char* args) {
+  int32_t v[2];
+  if (!parse_ints(args, v, 2) || v[0] <= 0 || v[1] <= 0) {
+    reply("Error: Invalid parameter\n");
+    return;
+  }
+  MotionConfig config = motion_config;
+  config.max_speed[axis] = v[0];
+  config.accel[axis] = v[1];
+  config_apply(config, "Command received and executed\n");
+}
+
+static void command_config_slider(const char* args) {
+  config_axis(0, args);
+}
+
+static void command_config_rotator(const char* args) {
+  config_axis(1, args);
+}
+
+// "config:hold:<axis>,<hold_ms>,<reduce_ms>", hold_ms -1 holds for ever
+static void command_config_hold(const char* args) {
+  int32_t v[3];
+  if (!parse_ints(args, v, 3) || v[0] < 0 || v[0] > 1 || v[1] < -1 || v[2] < 0 ||
+      !config_hold_valid((uint32_t)v[1])) {
+    reply("Error: Invalid parameter\n");
+    return;
+  }
+  MotionConfig config = motion_config;
+  config.hold_ms[v[0]] = (uint32_t)v[1];
+  config.reduce_ms[v[0]] = v[2];
+  config_apply(config, "Command received and executed\n");
+}
+
+// "hold?" coil hold policy and what it has done
+static void command_hold_report(const char* args) {
+  static const char* const names[2] = {"slider", "rotator"};
+  (void)args;
+  uint32_t now = micros();
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    const HoldAxis& hold = motion_hold(axis);
+    resp_str(out, "hold ");
+    resp_str(out, names[axis]);
+    resp_char(out, ' ');
+    if (hold.hold_ms == HOLD_FOREVER) {
+      resp_str(out, "forever");
+    } else {
+      resp_uint(out, hold.hold_ms);
+      resp_str(out, " ms");
+    }
+    if (hold.reducible) {
+      resp_str(out, ", reduce ");
+      resp_uint(out, hold.reduce_ms);
+      resp_str(out, " ms, reduced ");
+      resp_uint(out, hold.reduced);
+    }
+    resp_str(out, ", on ");
+    resp_uint(out, hold.energized);
+    resp_str(out, " off ");
+    resp_uint(out, hold.released);
+    resp_str(out, ", coils on ");
+    resp_uint(out, (uint32_t)(hold_on_us(hold, now) / 1000));
+    resp_str(out, " ms\n");
+  }
+  resp_flush(out);
+}
+
+// "wear?" lifetime counters, binary (see wear.h)
+static void command_wear_report(const char* args) {
+  (void)args;
+  uint8_t buf[WEAR_REPORT_MAX];
+  WearStats life;
+  wear_snapshot(wear, life);
+  size_t len = wear_report(life, buf, sizeof(buf));
+  for (size_t i = 0; i < len; i++) {
+    resp_char(out, buf[i]);
+  }
+  resp_flush(out);
+}
+
+// "wear:save" writes the counters now, e.g. before switching off
+static void command_wear_save(const char* args) {
+  (void)args;
+  reply_done(!motion_busy() && wear_poll(wear, true, micros(), true));
+}
+
+// "log?" event log report
+static void command_log_report(const char* args) {
+  (void)args;
+  resp_str(out, "log ");
+  resp_str(out, event_log.enabled ? "on, " : "off, ");
+  resp_uint(out, event_log.events);
+  resp_str(out, " events, ");
+  resp_uint(out, event_log.dropped);
+  resp_str(out, " dropped, ");
+  resp_uint(out, event_log.len);
+  resp_str(out, " B in RAM, ");
+  resp_uint(out, event_log.file_bytes);
+  reply(" B flushed\n");
+}
+
+static void command_log_start(const char* args) {
+  (void)args;
+  evlog_request(event_log, EVLOG_REQ_START);
+  reply_done(true);
+}
+
+static void command_log_stop(const char* args) {
+  (void)args;
+  evlog_request(event_log, EVLOG_REQ_STOP);
+  reply_done(true);
+}
+
+static void command_log_flush(const char* args) {
+  (void)args;
+  evlog_request(event_log, EVLOG_REQ_FLUSH);
+  reply_done(true);
+}
+
+// "link?" reports throughput and reply turnaround per connection mode, for
+// each connected peer
+static void command_link(const char* args) {
+  static const char* const names[LINK_MODES] = {"idle", "active"};
+  (void)args;
+  if (peers_count(ble_peers) == 0) {
+    reply("link none\n");
+    return;
+  }
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    const Peer& peer = ble_peers.peer[id];
+    if (!peer.connected) {
+      continue;
+    }
+    for (uint8_t mode = 0; mode < LINK_MODES; mode++) {
+      const LinkModeStats& stats = peer.link.stats[mode];
+      resp_str(out, "link ");
+      resp_uint(out, id);
+      resp_char(out, ' ');
+      resp_str(out, names[mode]);
+      resp_str(out, ": ");
+      resp_uint(out, stats.rx_bytes);
+      resp_str(out, " B, ");
+      resp_uint(out, link_throughput(peer.link, (LinkMode)mode));
+      resp_str(out, " B/s, ");
+      resp_uint(out, stats.replies);
+      resp_str(out, " replies, turnaround max ");
+      resp_uint(out, stats.turnaround_max_us);
+      resp_str(out, " us\n");
+    }
+  }
+  resp_flush(out);
+}
+
+// "peers?" one line per connected peer, '*' marks the one in control
+static void command_peers(const char* args) {
+  (void)args;
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    const Peer& peer = ble_peers.peer[id];
+    if (!peer.connected) {
+      continue;
+    }
+    resp_str(out, "peer ");
+    resp_uint(out, id);
+    resp_str(out, ble_peers.owner == id ? "*" : "");
+    resp_str(out, peer.watching ? " watching, rx " : ", rx ");
+    resp_uint(out, peer.stats.rx_bytes);
+    resp_str(out, " B, tx ");
+    resp_uint(out, peer.stats.tx_bytes);
+    resp_str(out, " B, dropped ");
+    resp_uint(out, peer.stats.rx_dropped);
+    resp_char(out, '/');
+    resp_uint(out, peer.stats.tx_dropped);
+    resp_str(out, ", refused ");
+    resp_uint(out, peer.stats.refused);
+    resp_char(out, '\n');
+  }
+  resp_str(out, "telemetry ");
+  resp_uint(out, ble_peers.telemetry_frames);
+  resp_str(out, " frames, ");
+  resp_uint(out, ble_peers.telemetry_sends);
+  reply(" sends\n");
+}
+
+// "watch:1" sends this peer the status object every PEER_TELEMETRY_US,
+// "watch:0" stops it
+static void command_watch(const char* args) {
+  int32_t on;
+  reply(parse_ints(args, &on, 1) && peers_watch(ble_peers, run_source, on != 0)
+            ? "Command received and executed\n"
+            : "Error: Invalid parameter\n");
+}
+
+// "release" gives up control so another peer can take it
+static void command_release(const char* args) {
+  (void)args;
+  peers_release(ble_peers, run_source);
+  reply_done(true);
+}
+
+// "clock:<t1>" first half of a clock exchange: replies "clock <t1> <t2> <t3>"
+// with t2 and t3 our time, as the line was taken and as the reply is written.
+// Both legs pass through the same tasks, so their queueing mostly cancels.
+static void command_clock(const char* args) {
+  uint32_t t2 = command_rx_us();
+  int32_t t1;
+  if (!parse_ints(args, &t1, 1)) {
+    reply("Error: Invalid parameter\n");
+    return;
+  }
+  resp_str(out, "clock ");
+  resp_int(out, t1);
+  resp_char(out, ' ');
+  resp_int(out, (int32_t)t2);
+  resp_char(out, ' ');
+  resp_int(out, (int32_t)micros());
+  reply("\n");
+}
+
+// "sync:<t1>,<t2>,<t3>,<t4>" second half, t4 the central's time the clock
+// reply arrived
+static void command_sync(const char* args) {
+  int32_t v[4];
+  if (!parse_ints(args, v, 4) || !sync_add(clock_sync, v[0], v[1], v[2], v[3])) {
+    reply("Error: Invalid parameter\n");
+    return;
+  }
+  motion_set_clock_skew(clock_sync.skew_ppb);
+  reply_done(true);
+}
+
+// "sync?" clock sync state and how late scheduled commands ran
+static void command_sync_report(const char* args) {
+  (void)args;
+  if (!clock_sync.synced) {
+    resp_str(out, "sync none");
+  } else {
+    resp_str(out, "sync offset ");
+    resp_int(out, (int32_t)clock_sync.offset_us);
+    resp_str(out, " us, skew ");
+    resp_int(out, clock_sync.skew_ppb);
+    resp_str(out, " ppb, delay ");
+    resp_uint(out, clock_sync.delay_us);
+    resp_str(out, " us, ");
+    resp_uint(out, clock_sync.used);
+    resp_char(out, '/');
+    resp_uint(out, clock_sync.count);
+    resp_str(out, " samples");
+  }
+  resp_str(out, ", exchanges ");
+  resp_uint(out, clock_sync.exchanges);
+  resp_str(out, ", rejected ");
+  resp_uint(out, clock_sync.rejected);
+  resp_str(out, ", when ");
+  resp_uint(out, when_runs);
+  resp_str(out, " runs, late ");
+  resp_uint(out, when_late_us);
+  resp_str(out, " us, max ");
+  resp_uint(out, when_late_max_us);
+  reply(" us\n");
+}
+
+// Keep when_next_us on the earliest pending command, for the timer interrupt.
+static void when_schedule() {
+  uint32_t now = micros();
+  uint32_t next = now + WHEN_AHEAD_MAX_US;
+  for (uint8_t i = 0; i < WHEN_MAX; i++) {
+    const WhenCommand& when = when_commands[i];
+    if (when.pending && (int32_t)(when.due_us - next) < 0) {
+      next = when.due_us;
+    }
+  }
+  when_next_us = next;
+}
+
+// "when:<time>:<command>" runs command when the central's clock reaches time
+// (our own clock before the first "sync:").  The command's reply comes when
+// it runs.
+static void command_when(const char* args) {
+  const char* p = args;
+  int32_t t;
+  if (!parse_int(p, t) || *p++ != ':') {
+    reply("Error: Invalid parameter\n");
+    return;
+  }
+  size_t len = strlen(p);
+  uint32_t now = micros();
+  int32_t wait = (int32_t)(sync_to_local(clock_sync, t) - now);
+  if (len == 0 || !command_known(p, len) || strncmp(p, "when:", 5) == 0 || wait < 0 ||
+      (uint32_t)wait > WHEN_AHEAD_MAX_US) {
+    reply("Error: Invalid parameter\n");
+    return;
+  }
+  for (uint8_t i = 0; i < WHEN_MAX; i++) {
+    WhenCommand& when = when_commands[i];
+    if (!when.pending) {
+      when.source = run_source;
+      when.len = len;
+      when.due_us = now + wait;
+      memcpy(when.text, p, len + 1);
+      when.pending = true;
+      when_pending++;
+      when_schedule();
+      reply_done(true);
+      return;
+    }
+  }
+  reply_done(false);
+}
+
+// Every command, once.  Keywords that take arguments end where the first
+// number starts; see include/ble_api.h for the syntax.
+static constexpr CommandEntry commands[] = {
+    {"a", command_nudge_a, COMMAND_CONTROL},
+    {"b", command_nudge_b, COMMAND_CONTROL},
+    {"s", command_s, 0},
+    {"x", command_estop, 0},
+    {"stop?", command_stop_report, 0},
+    {"ping", command_ping, 0},
+    {"tasks?", command_tasks, 0},
+    {"startup?", command_startup, 0},
+    {"config?", command_config_report, 0},
+    {"config:save", command_config_save, COMMAND_CONTROL},
+    {"config:load", command_config_load, COMMAND_CONTROL},
+    {"config:reset", command_config_reset, COMMAND_CONTROL},
+    {"config:slider:", command_config_slider, COMMAND_ARGS | COMMAND_CONTROL},
+    {"config:rotator:", command_config_rotator, COMMAND_ARGS | COMMAND_CONTROL},
+    {"config:hold:", command_config_hold, COMMAND_ARGS | COMMAND_CONTROL},
+    {"hold?", command_hold_report, 0},
+    {"wear?", command_wear_report, 0},
+    {"wear:save", command_wear_save, COMMAND_CONTROL},
+    {"log?", command_log_report, 0},
+    {"log:start", command_log_start, COMMAND_CONTROL},
+    {"log:stop", command_log_stop, COMMAND_CONTROL},
+    {"log:flush", command_log_flush, COMMAND_CONTROL},
+    {"link?", command_link, 0},
+    {"peers?", command_peers, 0},
+    {"watch:", command_watch, COMMAND_ARGS},
+    {"release", command_release, 0},
+    {"clock:", command_clock, COMMAND_ARGS},
+    {"sync:", command_sync, COMMAND_ARGS | COMMAND_CONTROL},
+    {"sync?", command_sync_report, 0},
+    {"when:", command_when, COMMAND_ARGS | COMMAND_CONTROL},
+    {"cruise:", command_cruise, COMMAND_ARGS | COMMAND_CONTROL},
+    {"table?", command_table_report, 0},
+    {"table:compile:", command_table_compile, COMMAND_ARGS | COMMAND_CONTROL},
+    {"table:save", command_table_save, COMMAND_CONTROL},
+    {"table:run", command_table_run, COMMAND_CONTROL},
+    {"key:", command_key, COMMAND_ARGS | COMMAND_CONTROL},
+    {"path:run", command_path_run, COMMAND_CONTROL},
+    {"path:clear", command_path_clear, COMMAND_CONTROL},
+    {"rec?", command_rec_report, 0},
+    {"rec:start", command_rec_start, COMMAND_CONTROL},
+    {"rec:stop", command_rec_stop, COMMAND_CONTROL},
+    {"rec:play", command_rec_play, COMMAND_CONTROL},
+    {"rec:play:", command_rec_play, COMMAND_ARGS | COMMAND_CONTROL},
+    {"rec:save", command_rec_save, COMMAND_CONTROL},
+    {"rec:load", command_rec_load, COMMAND_CONTROL},
+    {"j?", command_jog_report, 0},
+    {"j:", command_jog, COMMAND_ARGS | COMMAND_CONTROL},
+};
+
+static constexpr uint32_t command_seed = command_find_seed(commands, 1, COMMAND_SEED_MAX);
+static_assert(command_seed != 0,
+              "no perfect hash for the command keywords, raise COMMAND_SLOT_BITS");
+static constexpr CommandSlots command_index = command_slots(commands, command_seed);
+
+void command_run(const char* text, size_t len, uint8_t source) {
+  command_run(text, len, source, micros());
+}
+
+void command_run(const char* text, size_t len, uint8_t source, uint32_t rx_us) {
+  size_t n = command_keyword_len(text, len);
+  const CommandEntry* command = command_lookup(commands, command_index, command_seed, text, n);
+  run_source = source;
+  run_rx_us = rx_us;
+  if (!command) {
+    reply("Error: Invalid command\n");
+  } else if (!(command->flags & COMMAND_ARGS) && n != len) {
+    reply("Error: Invalid parameter\n");
+  } else if ((command->flags & COMMAND_CONTROL) && motion_estopped()) {
+    reply("Error: Stopped\n");
+  } else if ((command->flags & COMMAND_CONTROL) && source != COMMAND_LOCAL &&
+             !peers_claim(ble_peers, source, motion_busy(), micros())) {
+    reply("Error: Not in control\n");
+  } else {
+    command->run(text + n);
+  }
+}
+
+void command_run_due(uint32_t now_us) {
+  if (!when_pending) {
+    return;
+  }
+  for (uint8_t i = 0; i < WHEN_MAX; i++) {
+    WhenCommand& when = when_commands[i];
+    if (!when.pending || (int32_t)(now_us - when.due_us) < 0) {
+      continue;
+    }
+    when.pending = false;
+    when_pending--;
+    when_runs++;
+    when_late_us = now_us - when.due_us;
+    if (when_late_us > when_late_max_us) {
+      when_late_max_us = when_late_us;
+    }
+    command_run(when.text, when.len, when.source, now_us);
+  }
+  when_schedule();
+}
+
+bool command_due_pending() {
+  return when_pending != 0;
+}
+
+bool command_due_ready(uint32_t now_us) {
+  return when_pending != 0 && (int32_t)(now_us - when_next_us) >= 0;
+}
+
+uint8_t command_source() {
+  return run_source;
+}
+
+uint32_t command_rx_us() {
+  return run_rx_us;
+}
+
+bool command_known(const char* text, size_t len) {
+  size_t n = command_keyword_len(text, len);
+  return command_lookup(commands, command_index, command_seed, text, n) != NULL;
+}
+
+bool command_feed(CommandLine& line, uint8_t source, uint8_t ch, uint32_t rx_us) {
+  if (line.len == 0 && (ch == 'a' || ch == 'b' || ch == 'x')) {
+    line.text[0] = ch;
+    line.text[1] = '\0';
+    command_run(line.text, 1, source, rx_us);
+    return true;
+  }
+
+  if (ch == '\n' || ch == '\r') {
+    if (line.overflow) {
+      // Running the start of it could move the slider somewhere unintended.
+      line.overflow = false;
+      line.len = 0;
+      run_source = source;
+      reply("Error: Invalid parameter\n");
+      return false;
+    }
+    if (line.len == 0) {
+      return false;
+    }
+    line.text[line.len] = '\0';
+    command_run(line.text, line.len, source, line.rx_us);
+    line.len = 0;
+    return false;
+  }
+
+  if (line.len == 0) {
+    line.rx_us = rx_us;
+  }
+  if (line.len < COMMAND_LINE_MAX - 1) {
+    line.text[line.len++] = ch;
+  } else {
+    line.overflow = true;
+  }
+  return false;
+}
+
+bool command_feed(uint8_t ch) {
+  return command_feed(local_line, COMMAND_LOCAL, ch, micros());
+}
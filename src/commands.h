@@ -0,0 +1,79 @@
+// commands.h
+//
+// Text command handling for the BLE UART.  Bytes are collected into lines
+// (terminated by '\n' or '\r') and dispatched; the legacy single character
+// 'a'/'b' nudges and the 'x' stop act immediately.  See include/ble_api.h.
+
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "resp_writer.h"
+
+#define COMMAND_LINE_MAX 64
+#define COMMAND_LOCAL 0xff  // source for Serial and scripts, never refused control
+#define WHEN_MAX 4  // commands waiting for their "when:" time
+#define WHEN_AHEAD_MAX_US 1800000000u  // "when:" times at most 30 min ahead
+
+// A line being assembled, one per source.
+struct CommandLine {
+  char text[COMMAND_LINE_MAX];
+  uint8_t len;
+  bool overflow;   // longer than COMMAND_LINE_MAX - 1, dropped up to the newline
+  uint32_t rx_us;  // when its first byte arrived
+};
+
+// Replies are streamed to sink in chunks of at most chunk bytes (MTU - 3).
+void command_set_reply(RespSink sink, uint16_t chunk);
+void command_set_chunk(uint16_t chunk);
+
+// Battery level reported by the status command, in percent and mV.
+void command_set_battery(uint8_t percent, uint16_t mv);
+
+// Write the "s" status object, e.g. for a benchmark or telemetry.
+void command_status(RespWriter& w);
+
+/**
+ * Feed one byte received from source at rx_us into its line.  A line too
+ * long for it is not run but answered "Error: Invalid parameter".
+ * @return true if the byte was a single character command, false if it should
+ * still be echoed to Serial
+ */
+bool command_feed(CommandLine& line, uint8_t source, uint8_t ch, uint32_t rx_us);
+
+// Feed a byte into the local line, received now.
+bool command_feed(uint8_t ch);
+
+/**
+ * Run one line; line[len] must be '\0'.  Control commands from a peer only
+ * run if it has or can take control (see peers.h).
+ * @param rx_us when the line arrived, now if not given
+ */
+void command_run(const char* line, size_t len, uint8_t source = COMMAND_LOCAL);
+void command_run(const char* line, size_t len, uint8_t source, uint32_t rx_us);
+
+/**
+ * Run the "when:" commands whose time has come, as their source.  Called by
+ * the command task when the motion timer finds one due (command_due_ready()),
+ * and by the simulator loop before each motion pass.
+ */
+void command_run_due(uint32_t now_us);
+
+/** @return true while a "when:" command is waiting */
+bool command_due_pending();
+
+/** @return true if a "when:" command is due, safe from an interrupt */
+bool command_due_ready(uint32_t now_us);
+
+/** @return the source of the line being run, to route its reply */
+uint8_t command_source();
+
+/** @return when the line being run arrived, for the latency figures */
+uint32_t command_rx_us();
+
+/** @return true if the line's keyword is a command, without running it */
+bool command_known(const char* line, size_t len);
+
+#endif  // COMMANDS_H
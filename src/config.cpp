@@ -0,0 +1,102 @@
+// config.cpp
+
+#include "config.h"
+
+#include "hold.h"
+
+MotionConfig motion_config;
+
+void config_defaults(MotionConfig& config) {
+  config.magic = CONFIG_MAGIC;
+  config.max_speed[0] = 900;
+  config.max_speed[1] = 2000;
+  config.accel[0] = 30;
+  config.accel[1] = 30;
+  config.jog_accel[0] = 300;
+  config.jog_accel[1] = 600;
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    config.hold_ms[axis] = 1000;
+    config.reduce_ms[axis] = 200;
+  }
+}
+
+bool config_hold_valid(uint32_t hold_ms) {
+  return hold_ms <= CONFIG_HOLD_MAX_MS || hold_ms == HOLD_FOREVER;
+}
+
+static bool config_valid(const MotionConfig& config) {
+  if (config.magic != CONFIG_MAGIC) {
+    return false;
+  }
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    if (!(config.max_speed[axis] > 0) || !(config.accel[axis] > 0) ||
+        !(config.jog_accel[axis] > 0) || !config_hold_valid(config.hold_ms[axis])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#ifdef ARDUINO
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+
+using namespace Adafruit_LittleFS_Namespace;
+
+bool config_load(MotionConfig& config) {
+  if (!InternalFS.begin()) {
+    return false;
+  }
+  File file = InternalFS.open(CONFIG_FILE, FILE_O_READ);
+  if (!file) {
+    return false;
+  }
+  MotionConfig loaded;
+  bool ok = file.read(&loaded, sizeof(loaded)) == sizeof(loaded) && config_valid(loaded);
+  file.close();
+  if (ok) {
+    config = loaded;
+  }
+  return ok;
+}
+
+bool config_save(const MotionConfig& config) {
+  if (!InternalFS.begin()) {
+    return false;
+  }
+  InternalFS.remove(CONFIG_FILE);
+  File file = InternalFS.open(CONFIG_FILE, FILE_O_WRITE);
+  if (!file) {
+    return false;
+  }
+  bool ok = file.write((const uint8_t*)&config, sizeof(config)) == sizeof(config);
+  file.close();
+  return ok;
+}
+#else
+#include <stdio.h>
+
+bool config_load(MotionConfig& config) {
+  FILE* file = fopen(CONFIG_FILE + 1, "rb");
+  if (!file) {
+    return false;
+  }
+  MotionConfig loaded;
+  bool ok = fread(&loaded, sizeof(loaded), 1, file) == 1 && config_valid(loaded);
+  fclose(file);
+  if (ok) {
+    config = loaded;
+  }
+  return ok;
+}
+
+bool config_save(const MotionConfig& config) {
+  FILE* file = fopen(CONFIG_FILE + 1, "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(&config, sizeof(config), 1, file) == 1;
+  fclose(file);
+  return ok;
+}
+#endif
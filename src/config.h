@@ -0,0 +1,39 @@
+// config.h
+//
+// Persisted motion configuration: speed and acceleration limits and the coil
+// hold policy for both axes, loaded from LittleFS early in boot and applied with
+// motion_configure().  A missing or stale file just means defaults.
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint.h>
+
+#define CONFIG_FILE "/config.bin"
+#define CONFIG_MAGIC 0x32474643  // "CFG2", bump when the layout changes
+#define CONFIG_HOLD_MAX_MS 3600000  // longer holds must be HOLD_FOREVER
+
+struct MotionConfig {
+  uint32_t magic;
+  float max_speed[2];     // steps/s, axis 0 = slider, 1 = rotator
+  float accel[2];         // steps/s^2 for position moves
+  float jog_accel[2];     // steps/s^2 for jog ramps
+  uint32_t hold_ms[2];    // coils on after a move, HOLD_FOREVER to never switch off
+  uint32_t reduce_ms[2];  // then reduced current where the driver has it, 0 = never
+};
+
+extern MotionConfig motion_config;
+
+void config_defaults(MotionConfig& config);
+
+/** @return true for a hold time MotionConfig can take */
+bool config_hold_valid(uint32_t hold_ms);
+
+/**
+ * Read the saved config.
+ * @return false, leaving config untouched, if there is none or it is stale
+ */
+bool config_load(MotionConfig& config);
+bool config_save(const MotionConfig& config);
+
+#endif  // CONFIG_H
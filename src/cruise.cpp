@@ -0,0 +1,39 @@
+// cruise.cpp
+
+#include "cruise.h"
+
+bool cruise_set(CruiseAxis& axis, int32_t milli_sps) {
+  uint32_t speed = milli_sps < 0 ? -milli_sps : milli_sps;
+  if (speed > CRUISE_MAX_MSPS) {
+    return false;
+  }
+  uint64_t scaled = (uint64_t)speed << 32;
+  axis.rate = scaled / CRUISE_DENOM;
+  axis.rate_rem = scaled % CRUISE_DENOM;
+  axis.rem = 0;
+  axis.phase = CRUISE_ONE / 2;
+  axis.dir = milli_sps < 0 ? -1 : 1;
+  axis.steps = 0;
+  return true;
+}
+
+int8_t cruise_tick(CruiseAxis& axis) {
+  axis.phase += axis.rate;
+  axis.rem += axis.rate_rem;
+  if (axis.rem >= CRUISE_DENOM) {
+    axis.rem -= CRUISE_DENOM;
+    axis.phase++;
+  }
+  if (axis.phase < CRUISE_ONE) {
+    return 0;
+  }
+  axis.phase -= CRUISE_ONE;
+  axis.steps += axis.dir;
+  return axis.dir;
+}
+
+int64_t cruise_expected_steps(int32_t milli_sps, uint64_t ticks) {
+  uint64_t speed = milli_sps < 0 ? -(int64_t)milli_sps : milli_sps;
+  int64_t steps = (speed * ticks + CRUISE_DENOM / 2) / CRUISE_DENOM;
+  return milli_sps < 0 ? -steps : steps;
+}
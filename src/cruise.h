@@ -0,0 +1,46 @@
+// cruise.h
+//
+// Ultra-slow constant velocity cruise.  Each axis keeps a 64-bit Q32.32 step
+// phase that advances by a fixed amount per timer tick; a step is emitted when
+// the phase passes a whole step.  The remainder of the rate division is
+// carried separately, so after N ticks an axis has made exactly
+// floor(N * rate / tick rate + 1/2) steps: no drift, however long the run.
+// Both axes advance on the same tick from the same starting phase, so they
+// stay phase locked.
+
+#ifndef CRUISE_H
+#define CRUISE_H
+
+#include <stdint.h>
+
+#define CRUISE_TICK_HZ 5000
+#define CRUISE_MAX_MSPS (CRUISE_TICK_HZ * 1000UL / 2)  // milli-steps/s
+#define CRUISE_ONE (1ULL << 32)
+#define CRUISE_DENOM (CRUISE_TICK_HZ * 1000UL)  // milli-steps/s per step/tick
+
+struct CruiseAxis {
+  uint64_t phase;     // Q32.32 steps
+  uint64_t rate;      // Q32.32 steps per tick
+  uint32_t rate_rem;  // remainder of the rate division, in 1/CRUISE_DENOM LSB
+  uint32_t rem;
+  int8_t dir;
+  int32_t steps;      // signed steps emitted since cruise_set()
+};
+
+/**
+ * Set the cruise speed in milli-steps per second (1000 = 1 step/s) and
+ * restart the phase at half a step.
+ * @return false if the speed is above CRUISE_MAX_MSPS
+ */
+bool cruise_set(CruiseAxis& axis, int32_t milli_sps);
+
+/**
+ * Advance one timer tick.
+ * @return +1 or -1 when a step is due, else 0
+ */
+int8_t cruise_tick(CruiseAxis& axis);
+
+// Steps an axis must have made after ticks at milli_sps, for drift checks.
+int64_t cruise_expected_steps(int32_t milli_sps, uint64_t ticks);
+
+#endif  // CRUISE_H
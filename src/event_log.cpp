@@ -0,0 +1,266 @@
+// event_log.cpp
+
+#include "event_log.h"
+
+#include <string.h>
+
+#include "motors.h"
+#include "peers.h"
+#include "varint.h"
+
+EvLog event_log;
+
+static bool file_start(const EvLogFileHeader& header);
+static bool file_append(const uint8_t* data, size_t len);
+
+static bool ring_put(EvLog& log, uint8_t type, uint32_t t_us, const uint8_t* data, uint8_t len) {
+  uint8_t record[EVLOG_RECORD_MAX];
+  // Limit events are queued from the interrupt, and frames are polled a peer
+  // at a time, so either can be a little older than the last record; keep
+  // time monotonic.
+  uint32_t dt = (int32_t)(t_us - log.last_us) > 0 ? t_us - log.last_us : 0;
+  size_t n = 0;
+  record[n++] = type << 5 | len;
+  n += varint_put(record + n, 5, dt);
+  memcpy(record + n, data, len);
+  n += len;
+
+  if (log.len + n > EVLOG_RING_BYTES) {
+    return false;
+  }
+  uint16_t at = (log.head + log.len) % EVLOG_RING_BYTES;
+  for (size_t i = 0; i < n; i++) {
+    log.ring[at] = record[i];
+    at = (at + 1) % EVLOG_RING_BYTES;
+  }
+  log.len += n;
+  log.last_us += dt;
+  return true;
+}
+
+static void log_event(EvLog& log, uint8_t type, uint32_t t_us, const uint8_t* data, uint8_t len) {
+  if (log.gap) {
+    if (!ring_put(log, EVLOG_GAP, t_us, NULL, 0)) {
+      log.dropped++;
+      return;
+    }
+    log.gap = false;
+  }
+  if (!ring_put(log, type, t_us, data, len)) {
+    log.dropped++;
+    log.gap = true;
+    return;
+  }
+  log.events++;
+}
+
+static void drain_irq(EvLog& log) {
+  while (log.irq_tail != log.irq_head) {
+    const EvLogIrq& irq = log.irq[log.irq_tail];
+    log_event(log, irq.type, irq.t_us, &irq.arg, 1);
+    log.irq_tail = (log.irq_tail + 1) % EVLOG_IRQ_SLOTS;
+  }
+  while (log.link_tail != log.link_head) {
+    const EvLogIrq& link = log.link[log.link_tail];
+    log_event(log, link.type, link.t_us, &link.arg, 1);
+    log.link_tail = (log.link_tail + 1) % EVLOG_LINK_SLOTS;
+  }
+}
+
+// What the replay starts from, as logging starts.
+static void header_fill(EvLogFileHeader& header, uint32_t start_us) {
+  memset(&header, 0, sizeof(header));
+  header.magic = EVLOG_MAGIC;
+  header.start_us = start_us;
+  header.position[0] = motion_position(0);
+  header.position[1] = motion_position(1);
+  header.config = motion_config;
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    if (ble_peers.peer[id].connected) {
+      header.peers |= 1 << id;
+    }
+  }
+  header.owner = ble_peers.owner;
+  header.owner_us = ble_peers.owner_us;
+}
+
+static void flush(EvLog& log, uint32_t now_us) {
+  log.last_flush_us = now_us;
+  while (log.len) {
+    size_t n = log.len;
+    if (log.head + n > EVLOG_RING_BYTES) {
+      n = EVLOG_RING_BYTES - log.head;
+    }
+    if (!file_append(log.ring + log.head, n)) {
+      return;  // keep it for the next try
+    }
+    log.file_bytes += n;
+    log.head = (log.head + n) % EVLOG_RING_BYTES;
+    log.len -= n;
+  }
+}
+
+void evlog_request(EvLog& log, EvLogRequest request) {
+  log.request = request;
+}
+
+void evlog_input(EvLog& log, EvLogType type, const uint8_t* data, size_t len, uint32_t now_us,
+                 uint8_t peer) {
+  if (!log.enabled) {
+    return;
+  }
+  drain_irq(log);
+  uint8_t payload[EVLOG_PAYLOAD_MAX];
+  uint8_t head = type == EVLOG_BLE ? 1 : 0;
+  size_t room = EVLOG_PAYLOAD_MAX - head;
+  payload[0] = peer;
+  while (len) {
+    uint8_t n = len > room ? room : len;
+    memcpy(payload + head, data, n);
+    log_event(log, type, now_us, payload, head + n);
+    data += n;
+    len -= n;
+  }
+}
+
+void evlog_limit(EvLog& log, uint8_t pin, uint32_t now_us) {
+  if (!log.enabled) {
+    return;
+  }
+  uint8_t next = (log.irq_head + 1) % EVLOG_IRQ_SLOTS;
+  if (next == log.irq_tail) {
+    return;  // switch bounce, the first edges are the ones that matter
+  }
+  log.irq[log.irq_head].t_us = now_us;
+  log.irq[log.irq_head].type = EVLOG_LIMIT;
+  log.irq[log.irq_head].arg = pin;
+  log.irq_head = next;
+}
+
+void evlog_link(EvLog& log, EvLogType type, uint8_t peer, uint32_t now_us) {
+  if (!log.enabled) {
+    return;
+  }
+  uint8_t next = (log.link_head + 1) % EVLOG_LINK_SLOTS;
+  if (next == log.link_tail) {
+    return;  // only if the command task has not run for several connections
+  }
+  log.link[log.link_head].t_us = now_us;
+  log.link[log.link_head].type = type;
+  log.link[log.link_head].arg = peer;
+  log.link_head = next;
+}
+
+void evlog_poll(EvLog& log, bool idle, uint32_t now_us) {
+  uint8_t request = log.request;
+  if (request != EVLOG_REQ_NONE) {
+    log.request = EVLOG_REQ_NONE;
+    if (request == EVLOG_REQ_START) {
+      log.enabled = false;
+      log.head = 0;
+      log.len = 0;
+      log.gap = false;
+      log.irq_tail = log.irq_head;
+      log.link_tail = log.link_head;
+      log.events = 0;
+      log.dropped = 0;
+      log.file_bytes = 0;
+      log.last_us = now_us;
+      log.last_flush_us = now_us;
+      EvLogFileHeader header;
+      header_fill(header, now_us);
+      log.enabled = file_start(header);
+    } else if (log.enabled) {
+      drain_irq(log);
+      log.enabled = request != EVLOG_REQ_STOP;
+      flush(log, now_us);
+    }
+  }
+
+  if (!log.enabled) {
+    return;
+  }
+  drain_irq(log);
+  if (idle && log.len &&
+      (log.len >= EVLOG_RING_BYTES / 2 || now_us - log.last_flush_us >= EVLOG_FLUSH_US)) {
+    flush(log, now_us);
+  }
+}
+
+size_t evlog_decode(const uint8_t* buf, size_t len, EvLogEvent& event) {
+  if (len < 2) {
+    return 0;
+  }
+  size_t n = varint_get(buf + 1, len - 1, &event.dt_us);
+  event.type = buf[0] >> 5;
+  event.len = buf[0] & EVLOG_PAYLOAD_MAX;
+  if (n == 0 || 1 + n + event.len > len) {
+    return 0;
+  }
+  event.payload = buf + 1 + n;
+  event.peer = EVLOG_LOCAL;
+  bool peer = event.type == EVLOG_BLE || event.type == EVLOG_CONNECT ||
+              event.type == EVLOG_DISCONNECT;
+  if (peer) {
+    if (event.len == 0) {
+      return 0;
+    }
+    event.peer = *event.payload++;
+    event.len--;
+  }
+  return 1 + n + event.len + peer;
+}
+
+#ifdef ARDUINO
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+
+using namespace Adafruit_LittleFS_Namespace;
+
+static bool file_start(const EvLogFileHeader& header) {
+  if (!InternalFS.begin()) {
+    return false;
+  }
+  InternalFS.remove(EVLOG_FILE);
+  File file = InternalFS.open(EVLOG_FILE, FILE_O_WRITE);
+  if (!file) {
+    return false;
+  }
+  bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+  file.close();
+  return ok;
+}
+
+// FILE_O_WRITE opens at the end of an existing file.
+static bool file_append(const uint8_t* data, size_t len) {
+  File file = InternalFS.open(EVLOG_FILE, FILE_O_WRITE);
+  if (!file) {
+    return false;
+  }
+  bool ok = file.write(data, len) == len;
+  file.close();
+  return ok;
+}
+#else
+#include <stdio.h>
+
+static bool file_start(const EvLogFileHeader& header) {
+  FILE* file = fopen(EVLOG_FILE + 1, "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  fclose(file);
+  return ok;
+}
+
+static bool file_append(const uint8_t* data, size_t len) {
+  FILE* file = fopen(EVLOG_FILE + 1, "ab");
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(data, 1, len, file) == len;
+  fclose(file);
+  return ok;
+}
+#endif
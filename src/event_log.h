@@ -0,0 +1,132 @@
+// event_log.h
+//
+// Input event log for reproducing field sessions.  Every input that can change
+// what the motors do (BLE UART frames, peers connecting and disconnecting,
+// limit switch interrupts) and Serial input for context is stored with its
+// time, so the simulator can feed the same bytes at the same microseconds
+// through the same command and motion code (slider_sim --replay).  Frames are
+// stamped as they arrive in peers_rx(), not when the command task gets to
+// them.  The file header holds what the replay starts from: the axis
+// positions, the MotionConfig in use, which peers were connected and which
+// one had control.
+//
+// Records go into a RAM ring and are appended to LittleFS from evlog_poll(),
+// only while nothing is moving since flash writes stall the CPU.  If the ring
+// fills first, new events are dropped and a gap record marks the hole.
+//
+// Record: one byte type << 5 | payload length, varint microseconds since the
+// previous record, then the payload.  A BLE payload starts with the id of the
+// peer that sent it (EVLOG_LOCAL for the simulator's local script lines), so
+// a replay can feed it through that peer's ring and arbitration; connect and
+// disconnect payloads are just the id.  Frames longer than a record holds are
+// split into records 0 us apart.
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#define EVLOG_RING_BYTES 4096
+#define EVLOG_PAYLOAD_MAX 31
+#define EVLOG_RECORD_MAX (1 + 5 + EVLOG_PAYLOAD_MAX)
+#define EVLOG_IRQ_SLOTS 4           // limit events waiting to enter the ring
+#define EVLOG_LINK_SLOTS 4          // connects and disconnects, likewise
+#define EVLOG_FLUSH_US 5000000      // flush at least this often when idle
+#define EVLOG_FILE "/events.log"
+#define EVLOG_MAGIC 0x334c5645      // "EVL3", bump when the layout changes
+#define EVLOG_LOCAL 0xff            // BLE frame not from a peer, as COMMAND_LOCAL
+
+enum EvLogType {
+  EVLOG_BLE,
+  EVLOG_SERIAL,
+  EVLOG_LIMIT,
+  EVLOG_GAP,
+  EVLOG_CONNECT,
+  EVLOG_DISCONNECT,
+};
+
+enum EvLogRequest { EVLOG_REQ_NONE, EVLOG_REQ_START, EVLOG_REQ_STOP, EVLOG_REQ_FLUSH };
+
+// A limit pin or a peer id, queued by another task or an interrupt.
+struct EvLogIrq {
+  uint32_t t_us;
+  uint8_t type;
+  uint8_t arg;
+};
+
+struct EvLog {
+  uint8_t ring[EVLOG_RING_BYTES];
+  uint16_t head;   // next byte to flush
+  uint16_t len;    // bytes waiting in the ring
+  uint32_t last_us;
+  uint32_t last_flush_us;
+  bool enabled;
+  bool gap;        // events were dropped since the last record
+  volatile uint8_t request;
+  // Single producer (limit ISR), single consumer (evlog_poll) queue.
+  EvLogIrq irq[EVLOG_IRQ_SLOTS];
+  volatile uint8_t irq_head;
+  volatile uint8_t irq_tail;
+  // Single producer (BLE task), single consumer (evlog_poll) queue.
+  EvLogIrq link[EVLOG_LINK_SLOTS];
+  volatile uint8_t link_head;
+  volatile uint8_t link_tail;
+  uint32_t events;
+  uint32_t dropped;
+  uint32_t file_bytes;
+};
+
+// Same layout on the device and the host.
+struct EvLogFileHeader {
+  uint32_t magic;
+  uint32_t start_us;      // micros() when logging started
+  int32_t position[2];    // steps, slider and rotator
+  MotionConfig config;
+  uint32_t owner_us;      // Peers::owner_us
+  uint8_t peers;          // bit per connected peer id
+  uint8_t owner;          // peer in control, PEER_NONE if none
+};
+
+struct EvLogEvent {
+  uint8_t type;
+  uint32_t dt_us;
+  uint8_t peer;  // EVLOG_BLE, CONNECT, DISCONNECT; payload is what follows
+  uint8_t len;
+  const uint8_t* payload;
+};
+
+extern EvLog event_log;
+
+// Ask the task that owns the log to start (truncating the file), stop or
+// flush it on its next evlog_poll().
+void evlog_request(EvLog& log, EvLogRequest request);
+
+// Log an input frame; no-op unless logging.  peer is stored with EVLOG_BLE
+// frames only.
+void evlog_input(EvLog& log, EvLogType type, const uint8_t* data, size_t len, uint32_t now_us,
+                 uint8_t peer = EVLOG_LOCAL);
+
+// Log a limit switch edge.  Safe to call from the interrupt.
+void evlog_limit(EvLog& log, uint8_t pin, uint32_t now_us);
+
+// Log a peer connecting or disconnecting (EVLOG_CONNECT, EVLOG_DISCONNECT),
+// from the BLE task.
+void evlog_link(EvLog& log, EvLogType type, uint8_t peer, uint32_t now_us);
+
+/**
+ * Handle requests, move limit events into the ring and write the ring out if
+ * idle and it is due.
+ * @param idle true if nothing is moving, so a flash write is harmless
+ */
+void evlog_poll(EvLog& log, bool idle, uint32_t now_us);
+
+/**
+ * Decode one record.
+ * @return bytes consumed, or 0 if buf ends mid-record
+ */
+size_t evlog_decode(const uint8_t* buf, size_t len, EvLogEvent& event);
+
+#endif  // EVENT_LOG_H
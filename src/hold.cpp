@@ -0,0 +1,64 @@
+// hold.cpp
+
+#include "hold.h"
+
+#include <string.h>
+
+void hold_init(HoldAxis& hold, uint32_t hold_ms, uint32_t reduce_ms) {
+  memset(&hold, 0, sizeof(hold));
+  hold.hold_ms = hold_ms;
+  hold.reduce_ms = reduce_ms;
+}
+
+// Move the coil time so far into the 64 bit total.
+static void hold_count(HoldAxis& hold, uint32_t now_us) {
+  hold.on_total_us += now_us - hold.counted_us;
+  hold.counted_us = now_us;
+}
+
+bool hold_wake(HoldAxis& hold, uint32_t now_us) {
+  hold.idle_us = now_us;
+  if (hold.out == HOLD_OFF) {
+    hold.energized++;
+    hold.counted_us = now_us;
+  } else {
+    hold_count(hold, now_us);
+  }
+  if (hold.out == HOLD_FULL) {
+    return false;
+  }
+  hold.out = HOLD_FULL;
+  return true;
+}
+
+bool hold_idle(HoldAxis& hold, uint32_t now_us) {
+  if (hold.out == HOLD_OFF) {
+    return false;
+  }
+  hold_count(hold, now_us);
+  // In ms so hold times up to HOLD_FOREVER don't overflow.
+  uint32_t idle_ms = (now_us - hold.idle_us) / 1000;
+  if (hold.hold_ms != HOLD_FOREVER && idle_ms >= hold.hold_ms) {
+    return hold_release(hold, now_us);
+  }
+  if (hold.out == HOLD_FULL && hold.reducible && hold.reduce_ms && idle_ms >= hold.reduce_ms) {
+    hold.out = HOLD_REDUCED;
+    hold.reduced++;
+    return true;
+  }
+  return false;
+}
+
+bool hold_release(HoldAxis& hold, uint32_t now_us) {
+  if (hold.out == HOLD_OFF) {
+    return false;
+  }
+  hold_count(hold, now_us);
+  hold.out = HOLD_OFF;
+  hold.released++;
+  return true;
+}
+
+uint64_t hold_on_us(const HoldAxis& hold, uint32_t now_us) {
+  return hold.on_total_us + (hold.out != HOLD_OFF ? now_us - hold.counted_us : 0);
+}
@@ -0,0 +1,62 @@
+// hold.h
+//
+// What an axis's coils do between moves.  Switching them off the moment an
+// axis stops saves heat but makes closely spaced moves re-energize every
+// time, and the rotor can slip while they are off; holding forever cooks the
+// motors.  Each axis holds for hold_ms after its last step (or wake) and is
+// then switched off.  Drivers with a current setting can drop to reduced
+// current after reduce_ms of the hold.  Coil time is added up on every
+// hold_wake() and hold_idle() while on, so the 32 bit clock, which wraps
+// every 71 minutes, is never differenced across more than a pass.
+// No Arduino dependencies, the caller supplies the time and drives the pins.
+
+#ifndef HOLD_H
+#define HOLD_H
+
+#include <stdint.h>
+
+#define HOLD_FOREVER 0xffffffffu  // hold_ms that never switches off
+
+enum HoldOutput : uint8_t {
+  HOLD_OFF,
+  HOLD_FULL,
+  HOLD_REDUCED,
+};
+
+struct HoldAxis {
+  uint32_t hold_ms;     // idle time before the coils are switched off
+  uint32_t reduce_ms;   // idle time before reduced current, 0 = never
+  bool reducible;       // the driver has a reduced current setting
+  uint8_t out;          // HoldOutput in effect
+  uint32_t idle_us;     // last step or wake
+  uint32_t counted_us;  // coil time is in on_total_us up to here
+  uint64_t on_total_us;
+  uint32_t energized;   // off to on
+  uint32_t released;    // on to off
+  uint32_t reduced;     // full to reduced
+};
+
+void hold_init(HoldAxis& hold, uint32_t hold_ms, uint32_t reduce_ms);
+
+/**
+ * The axis is stepping or about to, full current from now on.
+ * @return true if the output changed
+ */
+bool hold_wake(HoldAxis& hold, uint32_t now_us);
+
+/**
+ * The axis did not step; reduce or switch off once it has been idle long enough.
+ * @return true if the output changed
+ */
+bool hold_idle(HoldAxis& hold, uint32_t now_us);
+
+/**
+ * Switch off now, e.g. the limit switch did it behind the policy's back.
+ * @return true if the output changed
+ */
+bool hold_release(HoldAxis& hold, uint32_t now_us);
+
+/** @return total time the coils have been on, including now */
+uint64_t hold_on_us(const HoldAxis& hold, uint32_t now_us);
+
+#endif  // HOLD_H
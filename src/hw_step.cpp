@@ -0,0 +1,185 @@
+// hw_step.cpp
+
+#include "hw_step.h"
+
+#include <math.h>
+#include <string.h>
+
+// Pack intervals from the source into slots until the half is full.  The
+// pulse is at the start of a slot, so the step that ends one interval opens
+// the slots of the next: a move starts with an idle interval and ends with a
+// lone step slot.  Intervals longer than the hardware counter continue in
+// filler slots, carrying the remainder across refills.
+static uint16_t fill_half(HwStepEngine& engine, uint8_t half) {
+  HwStepSlot* slots = engine.buf[half];
+  uint16_t len = 0;
+  engine.half_steps[half] = 0;
+  while (len < HW_STEP_HALF_LEN && !engine.drained) {
+    if (engine.carry_us == 0) {
+      engine.carry_us = engine.source(engine.ctx);
+      if (engine.carry_us == HW_STEP_NOT_READY) {
+        // Play what there is.  A half can't be empty, that means stop, so
+        // an empty one gets an idle slot and the source is asked again on
+        // the next refill.
+        engine.carry_us = 0;
+        if (len == 0) {
+          HwStepSlot& slot = slots[len++];
+          slot.pulse = HW_STEP_PULSE_ACTIVE;
+          slot.unused[0] = 0;
+          slot.unused[1] = 0;
+          slot.top = HW_STEP_STALL_US;
+          engine.stalls++;
+        }
+        break;
+      }
+      if (engine.carry_us == 0) {
+        engine.drained = true;
+        if (!engine.step_due) {
+          break;
+        }
+        engine.carry_us = 2 * HW_STEP_PULSE_US;  // the last step
+      } else if (engine.carry_us <= HW_STEP_PULSE_US) {
+        engine.carry_us = HW_STEP_PULSE_US + 1;
+      }
+    }
+
+    // Keep every slot long enough to hold the pulse.
+    uint32_t chunk = engine.carry_us;
+    if (chunk > HW_STEP_TOP_MAX) {
+      chunk = chunk - HW_STEP_TOP_MAX > HW_STEP_PULSE_US ? HW_STEP_TOP_MAX : HW_STEP_TOP_MAX / 2;
+    }
+    HwStepSlot& slot = slots[len++];
+    slot.pulse = HW_STEP_PULSE_ACTIVE | (engine.step_due ? HW_STEP_PULSE_US : 0);
+    slot.unused[0] = 0;
+    slot.unused[1] = 0;
+    slot.top = chunk;
+    engine.half_steps[half] += engine.step_due;
+    engine.carry_us -= chunk;
+    engine.step_due = engine.carry_us == 0;
+  }
+  return len;
+}
+
+void hw_step_init(HwStepEngine& engine, const HwStepHal* hal) {
+  memset(&engine, 0, sizeof(engine));
+  engine.hal = hal;
+}
+
+bool hw_step_start(HwStepEngine& engine, HwStepSource source, void* ctx) {
+  if (engine.running) {
+    return false;
+  }
+  engine.source = source;
+  engine.ctx = ctx;
+  engine.carry_us = 0;
+  engine.steps = 0;
+  engine.refills = 0;
+  engine.stalls = 0;
+  engine.drained = false;
+  engine.stopping = false;
+  engine.step_due = false;
+  engine.playing = 0;
+
+  uint16_t first = fill_half(engine, 0);
+  if (first == 0) {
+    return false;
+  }
+  uint16_t second = fill_half(engine, 1);
+  engine.running = true;
+  engine.hal->start(&engine, engine.buf[0], first, engine.buf[1], second);
+  return true;
+}
+
+void hw_step_stop(HwStepEngine& engine) {
+  if (engine.running) {
+    engine.stopping = true;
+    engine.hal->stop();
+  }
+}
+
+void hw_step_half_done(HwStepEngine& engine, uint8_t half) {
+  engine.steps += engine.half_steps[half];
+  engine.playing = half ^ 1;
+  engine.refills++;
+  uint16_t len = fill_half(engine, half);
+  engine.hal->queue(half, engine.buf[half], len);
+}
+
+void hw_step_finished(HwStepEngine& engine, uint32_t played_us) {
+  if (!engine.running) {
+    return;
+  }
+  const HwStepSlot* slots = engine.buf[engine.playing];
+  if (!engine.stopping) {
+    engine.steps += engine.half_steps[engine.playing];
+  } else {
+    // Stopped part way through: the hardware finishes the slot it is on, so
+    // count the step slots that had ended.  The rest never reached the driver.
+    uint32_t t = 0;
+    uint16_t counted = 0;
+    for (uint16_t i = 0; counted < engine.half_steps[engine.playing]; i++) {
+      t += slots[i].top;
+      if (t > played_us) {
+        break;
+      }
+      counted += hw_step_slot_steps(slots[i]);
+    }
+    engine.steps += counted;
+  }
+  engine.running = false;
+}
+
+void hw_step_ramp_init(HwStepRamp& ramp, uint32_t steps, float max_speed, float accel) {
+  ramp.total = steps;
+  ramp.done = 0;
+  ramp.c0 = 0.676f * sqrtf(2.0f / accel) * 1000000.0f;
+  ramp.cn = ramp.c0;
+  ramp.cmin = 1000000.0f / max_speed;
+
+  uint32_t ramp_steps = (uint32_t)(max_speed * max_speed / (2.0f * accel));
+  if (ramp_steps > steps / 2) {
+    ramp_steps = steps / 2;
+  }
+  ramp.ramp_steps = ramp_steps;
+  ramp.decel_steps = ramp_steps;
+  ramp.stop_decel = 0;
+}
+
+void hw_step_ramp_stop(HwStepRamp& ramp, float decel) {
+  ramp.stop_decel = decel;
+}
+
+uint32_t hw_step_ramp_next(void* ctx) {
+  HwStepRamp& ramp = *(HwStepRamp*)ctx;
+  float decel = ramp.stop_decel;
+  if (decel > 0) {
+    // Steps to stop from the current speed; the mirrored recurrence started
+    // that far from the end slows down at decel.
+    ramp.stop_decel = 0;
+    float speed = 1000000.0f / ramp.cn;
+    uint32_t stop = ramp.done ? (uint32_t)(speed * speed / (2.0f * decel)) : 0;
+    if (stop < ramp.total - ramp.done) {
+      ramp.total = ramp.done + stop;
+      ramp.decel_steps = stop;
+    }
+  }
+  if (ramp.done >= ramp.total) {
+    return 0;
+  }
+
+  uint32_t n = ++ramp.done;
+  uint32_t remaining = ramp.total - n;
+  if (n == 1) {
+    ramp.cn = ramp.c0;
+  } else if (remaining < ramp.decel_steps) {
+    // Mirror of the acceleration recurrence.
+    uint32_t k = remaining + 1;
+    ramp.cn = ramp.cn * (4.0f * k + 1.0f) / (4.0f * k - 1.0f);
+  } else if (n <= ramp.ramp_steps) {
+    ramp.cn -= 2.0f * ramp.cn / (4.0f * (n - 1) + 1.0f);
+  }
+  if (ramp.cn < ramp.cmin) {
+    ramp.cn = ramp.cmin;
+  }
+  return (uint32_t)ramp.cn;
+}
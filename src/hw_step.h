@@ -0,0 +1,129 @@
+// hw_step.h
+//
+// Optional hardware step pulse backend for STEP/DIR drivers.
+//
+// Step intervals are packed into two half-buffers of waveform slots which the
+// hardware plays back on its own (nRF52 PWM in waveform mode, fed by EasyDMA).
+// The CPU only touches the engine once per half-buffer to refill it, instead of
+// once per step.  All the buffer sequencing lives in hw_step.cpp and is plain
+// C++, so it can be driven by the mock HAL in hw_step_mock.cpp on the host.
+
+#ifndef HW_STEP_H
+#define HW_STEP_H
+
+#include <stdint.h>
+
+#define HW_STEP_HALF_LEN 32       // slots per half-buffer
+#define HW_STEP_TICK_HZ 1000000   // slot clock, 1 tick = 1 us
+#define HW_STEP_TOP_MAX 32767     // longest slot the hardware counter can hold
+#define HW_STEP_PULSE_US 4        // STEP high time, A4988/DRV8825 need >= 2 us
+// Bit 15 of a PWM compare value is the channel polarity, not a step marker.
+// Every slot sets it so the pin idles low; a filler slot has compare 0 and
+// stays at the idle level for the whole slot.
+#define HW_STEP_PULSE_ACTIVE 0x8000
+
+/**
+ * One waveform slot, laid out as the nRF52 PWM "WaveForm" decoder expects:
+ * three compare values followed by the counter top.  Only channel 0 is used.
+ */
+struct HwStepSlot {
+  uint16_t pulse;   // HW_STEP_PULSE_ACTIVE | high ticks, 0 ticks for a filler slot
+  uint16_t unused[2];
+  uint16_t top;     // slot length in ticks
+};
+
+#define HW_STEP_NOT_READY 0xffffffffUL  // source has no interval yet, ask again later
+#define HW_STEP_STALL_US 1000              // idle slot played while the source is not ready
+
+/**
+ * Source of step intervals.
+ * @return microseconds until the next step, 0 when the move is done, or
+ *         HW_STEP_NOT_READY to hold the axis for HW_STEP_STALL_US
+ */
+typedef uint32_t (*HwStepSource)(void* ctx);
+
+struct HwStepEngine;
+
+/** Hardware hooks, implemented once per target. */
+struct HwStepHal {
+  void (*start)(HwStepEngine* engine, const HwStepSlot* first, uint16_t first_len,
+                const HwStepSlot* second, uint16_t second_len);
+  // Arm a half that has just finished playing; len == 0 means stop after the
+  // other half.
+  void (*queue)(uint8_t half, const HwStepSlot* slots, uint16_t len);
+  void (*stop)();
+};
+
+struct HwStepEngine {
+  const HwStepHal* hal;
+  HwStepSource source;
+  void* ctx;
+  HwStepSlot buf[2][HW_STEP_HALF_LEN];
+  uint32_t carry_us;   // part of a long interval still to be emitted
+  uint32_t steps;      // steps the hardware has emitted this move
+  uint16_t half_steps[2];  // steps queued in each half, counted once it plays
+  uint32_t refills;    // half-buffer refills this move
+  uint32_t stalls;     // idle slots played while the source was not ready
+  volatile bool running;
+  bool drained;
+  bool step_due;       // the next slot opens with a step
+  bool stopping;       // hw_step_stop() called, the playing half may be cut short
+  uint8_t playing;     // half the hardware is on
+};
+
+static inline bool hw_step_slot_steps(const HwStepSlot& slot) {
+  return (slot.pulse & ~HW_STEP_PULSE_ACTIVE) != 0;
+}
+
+void hw_step_init(HwStepEngine& engine, const HwStepHal* hal);
+bool hw_step_start(HwStepEngine& engine, HwStepSource source, void* ctx);
+void hw_step_stop(HwStepEngine& engine);
+
+// Called by the HAL, usually from its interrupt handler.
+void hw_step_half_done(HwStepEngine& engine, uint8_t half);
+/**
+ * @param played_us how long the hardware had been playing the current half
+ *        when it stopped; only steps within it are counted after a stop
+ */
+void hw_step_finished(HwStepEngine& engine, uint32_t played_us);
+
+/**
+ * Trapezoidal interval source (David Austin's recurrence, as AccelStepper
+ * uses), so a plain relative move can be handed to the hardware backend.
+ */
+struct HwStepRamp {
+  uint32_t total;
+  uint32_t done;
+  uint32_t ramp_steps;
+  uint32_t decel_steps;       // ramp_steps, unless cut short
+  float c0;
+  float cn;
+  float cmin;
+  volatile float stop_decel;  // from hw_step_ramp_stop(), taken by the next interval
+};
+
+void hw_step_ramp_init(HwStepRamp& ramp, uint32_t steps, float max_speed, float accel);
+uint32_t hw_step_ramp_next(void* ctx);
+
+/**
+ * Cut the move short, e.g. for an emergency stop: decelerate from the
+ * current speed at decel (steps/s^2) and end there, unless the move ends
+ * sooner anyway.  Safe while the engine is running; the intervals already
+ * queued in the halves still play first.
+ */
+void hw_step_ramp_stop(HwStepRamp& ramp, float decel);
+
+#ifdef NRF52_SERIES
+extern const HwStepHal hw_step_nrf52_hal;
+void hw_step_nrf52_begin(uint8_t step_pin);
+#endif
+
+#ifndef ARDUINO
+extern const HwStepHal hw_step_mock_hal;
+typedef void (*HwStepMockStep)(uint32_t t_us, void* ctx);
+// Play the queued halves back in virtual time until the engine stops.
+// Returns the virtual time of the end of the last slot.
+uint32_t hw_step_mock_run(HwStepEngine& engine, HwStepMockStep on_step, void* ctx);
+#endif
+
+#endif  // HW_STEP_H
@@ -0,0 +1,72 @@
+// hw_step_mock.cpp
+//
+// Host stand-in for the hw_step hardware.  It plays the queued halves back in
+// virtual time, calling hw_step_half_done() at each half boundary exactly as
+// the PWM SEQEND interrupt would, so interval sequencing and refills can be
+// checked on Linux.
+
+#ifndef ARDUINO
+
+#include "hw_step.h"
+
+struct MockSeq {
+  const HwStepSlot* slots;
+  uint16_t len;
+};
+
+static MockSeq seq[2];
+static HwStepEngine* mock_engine;
+static bool stop_pending;
+static bool stop_requested;
+
+static void mock_start(HwStepEngine* engine, const HwStepSlot* first, uint16_t first_len,
+                       const HwStepSlot* second, uint16_t second_len) {
+  mock_engine = engine;
+  stop_pending = second_len == 0;
+  stop_requested = false;
+  seq[0].slots = first;
+  seq[0].len = first_len;
+  seq[1].slots = second;
+  seq[1].len = second_len;
+}
+
+static void mock_queue(uint8_t half, const HwStepSlot* slots, uint16_t len) {
+  if (len == 0) {
+    stop_pending = true;
+    return;
+  }
+  seq[half].slots = slots;
+  seq[half].len = len;
+}
+
+static void mock_stop() {
+  stop_requested = true;
+}
+
+const HwStepHal hw_step_mock_hal = {mock_start, mock_queue, mock_stop};
+
+uint32_t hw_step_mock_run(HwStepEngine& engine, HwStepMockStep on_step, void* ctx) {
+  uint32_t now = 0;
+  uint8_t half = 0;
+  while (engine.running && mock_engine == &engine) {
+    const MockSeq& playing = seq[half];
+    uint32_t played = 0;
+    for (uint16_t i = 0; i < playing.len && !stop_requested; i++) {
+      const HwStepSlot& slot = playing.slots[i];
+      if (hw_step_slot_steps(slot) && on_step) {
+        on_step(now, ctx);
+      }
+      now += slot.top;
+      played += slot.top;
+    }
+    if (stop_pending || stop_requested) {
+      hw_step_finished(engine, played);
+      break;
+    }
+    hw_step_half_done(engine, half);
+    half ^= 1;
+  }
+  return now;
+}
+
+#endif  // ARDUINO
@@ -0,0 +1,128 @@
+// hw_step_nrf52.cpp
+//
+// nRF52 backend for hw_step: PWM3 in WaveForm decoder mode.  Each slot sets
+// its own counter top, so the peripheral walks through the step intervals by
+// EasyDMA with no CPU involvement.  SEQ[0] and SEQ[1] are the two halves;
+// SEQEND[n] fires once per half and is the only interrupt per batch.
+//
+// The end of a move is stopped by a SEQEND -> STOP shortcut on the last half
+// rather than from the interrupt: the last slot of a move is only
+// 2 * HW_STEP_PULSE_US long, and by the time the interrupt ran the PWM would
+// be into the other half, which still holds steps from two halves back.  That
+// half is pointed at an idle slot as well.
+//
+// A TIMER + PPI + GPIOTE chain can toggle the pin for free, but PPI has no way
+// to load the next compare value, so it would still need an interrupt per
+// step.  PWM3 is left alone by the core's HardwarePWM for analogWrite().
+
+#if defined(NRF52_SERIES) && defined(HW_STEP_BACKEND)
+
+#include <Arduino.h>
+
+#include "hw_step.h"
+
+#define HW_STEP_PWM NRF_PWM3
+#define HW_STEP_IRQn PWM3_IRQn
+#define HW_STEP_IRQ_PRIORITY 3
+
+static HwStepEngine* active_engine;
+static volatile bool stop_pending;
+static uint32_t half_start_us;  // when the playing half started, to count steps on a stop
+// Follows the last half in case the stop comes late.  In RAM, EasyDMA cannot
+// read flash.
+static HwStepSlot idle_slot = {HW_STEP_PULSE_ACTIVE, {0, 0}, HW_STEP_STALL_US};
+static const uint32_t stop_after[2] = {PWM_SHORTS_SEQEND0_STOP_Msk, PWM_SHORTS_SEQEND1_STOP_Msk};
+
+void hw_step_nrf52_begin(uint8_t step_pin) {
+  pinMode(step_pin, OUTPUT);
+  digitalWrite(step_pin, LOW);
+
+  HW_STEP_PWM->PSEL.OUT[0] = g_ADigitalPinMap[step_pin];
+  HW_STEP_PWM->MODE = PWM_MODE_UPDOWN_Up;
+  HW_STEP_PWM->PRESCALER = PWM_PRESCALER_PRESCALER_DIV_16;  // 1 MHz
+  HW_STEP_PWM->DECODER = (PWM_DECODER_LOAD_WaveForm << PWM_DECODER_LOAD_Pos) |
+                         (PWM_DECODER_MODE_RefreshCount << PWM_DECODER_MODE_Pos);
+  HW_STEP_PWM->SEQ[0].REFRESH = 0;
+  HW_STEP_PWM->SEQ[0].ENDDELAY = 0;
+  HW_STEP_PWM->SEQ[1].REFRESH = 0;
+  HW_STEP_PWM->SEQ[1].ENDDELAY = 0;
+  // Keep alternating SEQ[0]/SEQ[1] until we explicitly stop.
+  HW_STEP_PWM->SHORTS = PWM_SHORTS_LOOPSDONE_SEQSTART0_Msk;
+  HW_STEP_PWM->INTENSET = PWM_INTENSET_SEQEND0_Msk | PWM_INTENSET_SEQEND1_Msk |
+                          PWM_INTENSET_STOPPED_Msk;
+  // Not enabled here: an enabled PWM owns the STEP pin, and between hardware
+  // moves AccelStepper (jog, stream, cruise) drives it as a GPIO.  ENABLE is
+  // set per move in nrf52_start() and cleared again on STOPPED.
+
+  NVIC_SetPriority(HW_STEP_IRQn, HW_STEP_IRQ_PRIORITY);
+  NVIC_ClearPendingIRQ(HW_STEP_IRQn);
+  NVIC_EnableIRQ(HW_STEP_IRQn);
+}
+
+static void set_seq(uint8_t half, const HwStepSlot* slots, uint16_t len) {
+  HW_STEP_PWM->SEQ[half].PTR = (uint32_t)slots;
+  HW_STEP_PWM->SEQ[half].CNT = len * 4;  // in 16-bit words
+}
+
+// The half now playing is the last: stop when it ends.
+static void stop_after_half(uint8_t half) {
+  stop_pending = true;
+  set_seq(half ^ 1, &idle_slot, 1);
+  HW_STEP_PWM->SHORTS = PWM_SHORTS_LOOPSDONE_SEQSTART0_Msk | stop_after[half];
+}
+
+static void nrf52_start(HwStepEngine* engine, const HwStepSlot* first, uint16_t first_len,
+                        const HwStepSlot* second, uint16_t second_len) {
+  active_engine = engine;
+  stop_pending = false;
+  HW_STEP_PWM->SHORTS = PWM_SHORTS_LOOPSDONE_SEQSTART0_Msk;
+  set_seq(0, first, first_len);
+  if (second_len) {
+    set_seq(1, second, second_len);
+  } else {
+    stop_after_half(0);
+  }
+  HW_STEP_PWM->LOOP = PWM_LOOP_CNT_Msk;
+  HW_STEP_PWM->EVENTS_STOPPED = 0;
+  HW_STEP_PWM->ENABLE = PWM_ENABLE_ENABLE_Enabled;
+  HW_STEP_PWM->TASKS_SEQSTART[0] = 1;
+  half_start_us = micros();
+}
+
+static void nrf52_queue(uint8_t half, const HwStepSlot* slots, uint16_t len) {
+  if (len == 0) {
+    stop_after_half(half ^ 1);
+    return;
+  }
+  set_seq(half, slots, len);
+}
+
+static void nrf52_stop() {
+  HW_STEP_PWM->TASKS_STOP = 1;
+}
+
+const HwStepHal hw_step_nrf52_hal = {nrf52_start, nrf52_queue, nrf52_stop};
+
+extern "C" void PWM3_IRQHandler(void) {
+  for (uint8_t half = 0; half < 2; half++) {
+    if (HW_STEP_PWM->EVENTS_SEQEND[half]) {
+      HW_STEP_PWM->EVENTS_SEQEND[half] = 0;
+      if (stop_pending) {
+        HW_STEP_PWM->TASKS_STOP = 1;  // normally the shortcut has already
+      } else if (active_engine) {
+        half_start_us = micros();
+        hw_step_half_done(*active_engine, half);
+      }
+    }
+  }
+  if (HW_STEP_PWM->EVENTS_STOPPED) {
+    HW_STEP_PWM->EVENTS_STOPPED = 0;
+    // Hand the pin back to GPIO so AccelStepper can drive it between moves.
+    HW_STEP_PWM->ENABLE = PWM_ENABLE_ENABLE_Disabled;
+    if (active_engine) {
+      hw_step_finished(*active_engine, micros() - half_start_us);
+    }
+  }
+}
+
+#endif  // NRF52_SERIES && HW_STEP_BACKEND
@@ -0,0 +1,76 @@
+// jog.cpp
+
+#include "jog.h"
+
+static float clampf(float v, float lo, float hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void jog_init(Jog& jog, uint8_t axis, float max_speed, float accel) {
+  JogAxis& a = jog.axis[axis];
+  a.target = 0;
+  a.speed = 0;
+  a.accel = accel;
+  a.max_speed = max_speed;
+}
+
+void jog_command(Jog& jog, float slider, float rotator, uint32_t now_us, uint32_t cmd_us) {
+  JogAxis& s = jog.axis[JOG_SLIDER];
+  JogAxis& r = jog.axis[JOG_ROTATOR];
+  s.target = clampf(slider, -s.max_speed, s.max_speed);
+  r.target = clampf(rotator, -r.max_speed, r.max_speed);
+
+  if (!jog.active) {
+    jog.last_tick_us = now_us;
+  }
+  jog.active = true;
+  jog.last_cmd_us = now_us;
+  jog.cmd_us = cmd_us;
+  jog.latency_pending = true;
+}
+
+bool jog_tick(Jog& jog, uint32_t now_us) {
+  if (!jog.active) {
+    return false;
+  }
+
+  if (now_us - jog.last_cmd_us > JOG_DEADMAN_US) {
+    jog.axis[JOG_SLIDER].target = 0;
+    jog.axis[JOG_ROTATOR].target = 0;
+  }
+
+  float dt = (now_us - jog.last_tick_us) * 1e-6f;
+  jog.last_tick_us = now_us;
+
+  bool moving = false;
+  for (uint8_t i = 0; i < JOG_AXES; i++) {
+    JogAxis& a = jog.axis[i];
+    float step = a.accel * dt;
+    a.speed = clampf(a.target, a.speed - step, a.speed + step);
+    moving |= a.speed != 0 || a.target != 0;
+  }
+  jog.active = moving;
+  return moving;
+}
+
+void jog_stop(Jog& jog, const float* speed, float accel, uint32_t now_us) {
+  for (uint8_t i = 0; i < JOG_AXES; i++) {
+    jog.axis[i].speed = speed[i];
+    jog.axis[i].target = 0;
+    jog.axis[i].accel = accel;
+  }
+  jog.active = true;
+  jog.last_cmd_us = now_us;
+  jog.last_tick_us = now_us;
+}
+
+void jog_applied(Jog& jog, uint32_t now_us) {
+  if (!jog.latency_pending) {
+    return;
+  }
+  jog.latency_pending = false;
+  jog.latency_us = now_us - jog.cmd_us;
+  if (jog.latency_us > jog.latency_max_us) {
+    jog.latency_max_us = jog.latency_us;
+  }
+}
@@ -0,0 +1,53 @@
+// jog.h
+//
+// Continuous velocity jog.  The client streams signed speed setpoints, each
+// axis slews its speed towards the setpoint at a fixed acceleration, and a
+// deadman timer pulls the setpoints back to zero if the stream stops.
+// No Arduino dependencies, the caller supplies the time.
+
+#ifndef JOG_H
+#define JOG_H
+
+#include <stdint.h>
+
+#define JOG_AXES 2
+#define JOG_SLIDER 0
+#define JOG_ROTATOR 1
+#define JOG_DEADMAN_US 300000  // clients should stream setpoints at >= 5 Hz
+
+struct JogAxis {
+  float target;     // steps/s requested by the client
+  float speed;      // steps/s currently commanded
+  float accel;      // steps/s^2
+  float max_speed;  // steps/s
+};
+
+struct Jog {
+  JogAxis axis[JOG_AXES];
+  bool active;
+  uint32_t last_cmd_us;   // last setpoint, for the deadman
+  uint32_t last_tick_us;
+  bool latency_pending;   // a setpoint has not reached the steppers yet
+  uint32_t cmd_us;
+  uint32_t latency_us;    // last arrival-to-setSpeed latency
+  uint32_t latency_max_us;
+};
+
+void jog_init(Jog& jog, uint8_t axis, float max_speed, float accel);
+// cmd_us is when the setpoint arrived, the latency is measured from it.
+void jog_command(Jog& jog, float slider, float rotator, uint32_t now_us, uint32_t cmd_us);
+
+/**
+ * Advance the speed ramps to now_us.
+ * @return true while any axis is still moving or has a non-zero setpoint
+ */
+bool jog_tick(Jog& jog, uint32_t now_us);
+
+// Take the axes over at their current speeds, e.g. for an emergency stop, and
+// ramp them to zero at accel.  The caller restores the jog acceleration after.
+void jog_stop(Jog& jog, const float* speed, float accel, uint32_t now_us);
+
+// Call once the new speeds have been handed to the steppers.
+void jog_applied(Jog& jog, uint32_t now_us);
+
+#endif  // JOG_H
@@ -2,8 +2,73 @@
 
 #include <AccelStepper.h>
 
-AccelStepper slider_stepper; // Defaults to AccelStepper::FULL4WIRE (4 pins) on 2, 3, 4, 5
-AccelStepper rotator_stepper(AccelStepper::FULL4WIRE, 7,8,9,10); 
+#include "clock_sync.h"
+#include "config.h"
+#include "cruise.h"
+#include "hold.h"
+#include "jog.h"
+#include "motors.h"
+#include "recorder.h"
+#include "spline.h"
+#include "step_table.h"
+#include "wear.h"
+
+// AccelStepper that can also be stepped once from the motion timer interrupt,
+// and says when runSpeed() will next step.
+class AxisStepper : public AccelStepper {
+ public:
+  using AccelStepper::AccelStepper;
+
+  // Same interval as runSpeed() works from, measured from the last step of
+  // any kind, so never early.  False when it has no speed.
+  bool step_due(uint32_t& due_us) {
+    float v = speed();
+    if (v == 0) {
+      return false;
+    }
+    due_us = last_step_us + (uint32_t)fabs(1000000.0 / v);
+    return true;
+  }
+
+  void step_once(int8_t dir) {
+    long pos = currentPosition() + dir;
+    _direction = dir > 0 ? DIRECTION_CW : DIRECTION_CCW;
+    setCurrentPosition(pos);
+    step(pos);
+  }
+
+  // Drive the coils for the current position.  disableOutputs() leaves them
+  // off until the next step, which would start from wherever the rotor is.
+  void energize() {
+    enableOutputs();
+    step4(currentPosition());
+  }
+
+ protected:
+  void step(long pos) override {
+    last_step_us = micros();
+    AccelStepper::step(pos);
+  }
+
+ private:
+  uint32_t last_step_us = 0;
+};
+
+#ifdef HW_STEP_BACKEND
+#include "hw_step.h"
+
+#define SLIDER_STEP_PIN 2
+#define SLIDER_DIR_PIN 3
+
+// STEP/DIR driver, pulses generated by the hw_step backend
+AxisStepper slider_stepper(AccelStepper::DRIVER, SLIDER_STEP_PIN, SLIDER_DIR_PIN);
+HwStepEngine slider_hw;
+HwStepRamp slider_ramp;
+long slider_hw_dist = 0; // applied to currentPosition() once the move finishes
+#else
+AxisStepper slider_stepper; // Defaults to AccelStepper::FULL4WIRE (4 pins) on 2, 3, 4, 5
+#endif
+AxisStepper rotator_stepper(AccelStepper::FULL4WIRE, 7,8,9,10); 
 
 
 #define TOP_LIMIT 0
@@ -11,11 +76,268 @@ AccelStepper rotator_stepper(AccelStepper::FULL4WIRE, 7,8,9,10);
 
 volatile byte ledState = LOW;
 
+enum MotionMode {
+  MOTION_POSITION, // AccelStepper moveTo() targets
+  MOTION_JOG,      // streamed velocity setpoints
+  MOTION_STREAM,   // periodic targets from a recording or a spline path
+  MOTION_CRUISE,   // constant velocity, stepped from the motion timer
+  MOTION_TABLE,    // precompiled step intervals
+};
+
+// Next target for a stream, false when it is finished.
+typedef bool (*StreamNext)(int32_t& slider, int32_t& rotator);
+
+volatile MotionMode motion_mode = MOTION_POSITION; // also read by the timer ISR
+Jog jog;
+
+Recorder recorder;
+RecPlayer player;
+uint32_t rec_next_us;
+Spline path;
+
+StreamNext stream_next;
+bool stream_homing;            // driving to the start position
+uint32_t stream_period_us;
+uint32_t stream_next_us;
+uint32_t stream_err_max_us;
+uint64_t stream_period_q16;    // period on our clock, 1/65536 us
+uint16_t stream_frac;          // fraction of a us carried between samples
+int32_t clock_skew_ppb = 0;    // from clock_sync, see motion_set_clock_skew()
+
+CruiseAxis cruise_slider;
+CruiseAxis cruise_rotator;
+
+StepTable table;               // compile buffer
+StepTableAxis table_axes[STEP_TABLE_AXES];
+StepTableStream table_stream[STEP_TABLE_AXES];
+uint32_t table_interval[STEP_TABLE_AXES]; // wait after the next step, 0 = axis done,
+                                          // STEP_TABLE_NOT_READY = stalled on a refill
+uint32_t table_due_us[STEP_TABLE_AXES];
+
+// Emergency stop: requested from anywhere, applied by the motion loop
+volatile bool estop_pending = false;
+volatile bool estop_latched = false;
+volatile uint32_t estop_request_us;
+bool estop_stopping = false;   // jog ramp-down in progress
+uint32_t estop_applied_us;
+uint32_t estop_stops = 0;
+uint32_t estop_last_us = 0;
+uint32_t estop_max_us = 0;
+
+// Coil hold policy
+HoldAxis hold[2];
+HoldCurrentHook hold_current_hook = NULL;
+volatile bool limit_pending = false; // the limit interrupt stopped the slider, see limit_poll()
+uint8_t limit_pin = TOP_LIMIT;       // the switch that tripped last
+int8_t limit_dir = 0;                // and the way the slider was going, 0 = not moving
+
+MotionTickHook tick_hook = NULL;
+LimitHook limit_hook = NULL;
+MotionRequestHook request_hook = NULL;
+
+// Battery limiter: speed and acceleration as configured, and the scale to apply
+volatile uint16_t power_scale_pending = 1000;
+uint16_t power_scale = 1000;
+float base_max_speed[2], base_accel[2], base_jog_speed[2], base_jog_accel[2];
+
+#ifdef NRF52_SERIES
+// Fixed rate tick for cruise, TIMER4 is not used by the core or SoftDevice.
+// With a tick hook installed it runs all the time and also paces the motion
+// task, otherwise only while cruising.  It counts freely: CC[0] is moved on
+// one tick at a time, CC[1] is the one-shot step deadline of
+// motion_wake_at() and CC[2] takes captures.
+#define MOTION_TIMER NRF_TIMER4
+#define MOTION_TIMER_IRQn TIMER4_IRQn
+#define MOTION_TICK_US (1000000 / CRUISE_TICK_HZ)
+
+static void motion_timer_begin(){
+  MOTION_TIMER->MODE = TIMER_MODE_MODE_Timer;
+  MOTION_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+  MOTION_TIMER->PRESCALER = 4; // 16 MHz / 2^4 = 1 MHz
+  MOTION_TIMER->CC[0] = MOTION_TICK_US;
+  MOTION_TIMER->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+  NVIC_SetPriority(MOTION_TIMER_IRQn, 3);
+  NVIC_EnableIRQ(MOTION_TIMER_IRQn);
+}
+
+static uint32_t motion_timer_now(){
+  MOTION_TIMER->TASKS_CAPTURE[2] = 1;
+  return MOTION_TIMER->CC[2];
+}
+
+static void motion_timer_start(){
+  MOTION_TIMER->TASKS_CLEAR = 1;
+  MOTION_TIMER->CC[0] = MOTION_TICK_US;
+  MOTION_TIMER->TASKS_START = 1;
+}
+
+static void motion_timer_stop(){
+  if (!tick_hook) {
+    MOTION_TIMER->TASKS_STOP = 1;
+  }
+}
+
+void motion_wake_at(uint32_t due_us){
+  int32_t wait = (int32_t)(due_us - micros());
+  uint32_t at = motion_timer_now() + (wait > 0 ? wait : 1);
+  if ((int32_t)(MOTION_TIMER->CC[0] - at) <= 0) {
+    return;  // the tick comes first
+  }
+  MOTION_TIMER->CC[1] = at;
+  MOTION_TIMER->EVENTS_COMPARE[1] = 0;
+  MOTION_TIMER->INTENSET = TIMER_INTENSET_COMPARE1_Msk;
+}
+
+extern "C" void TIMER4_IRQHandler(void){
+  if (MOTION_TIMER->EVENTS_COMPARE[0]) {
+    MOTION_TIMER->EVENTS_COMPARE[0] = 0;
+    // Ticks held up past the next compare are run here, cruise never drops one.
+    do {
+      MOTION_TIMER->CC[0] += MOTION_TICK_US;
+      motion_timer_tick();
+    } while ((int32_t)(MOTION_TIMER->CC[0] - motion_timer_now()) <= 0);
+    if (tick_hook) {
+      tick_hook();
+    }
+  }
+  if (MOTION_TIMER->EVENTS_COMPARE[1]) {
+    MOTION_TIMER->EVENTS_COMPARE[1] = 0;
+    MOTION_TIMER->INTENCLR = TIMER_INTENCLR_COMPARE1_Msk;
+    if (tick_hook) {
+      tick_hook();
+    }
+  }
+}
+#else
+// The simulator calls motion_timer_tick() itself, and schedules the step
+// deadline passes from motion_next_step().
+static void motion_timer_begin(){}
+static void motion_timer_start(){}
+static void motion_timer_stop(){}
+void motion_wake_at(uint32_t due_us){
+  (void)due_us;
+}
+#endif
+
+static AxisStepper& axis_stepper(uint8_t axis){
+  return axis == 0 ? slider_stepper : rotator_stepper;
+}
+
+// Set the pins for the output the hold policy just changed to.
+static void coils_apply(uint8_t axis, uint8_t was){
+  AxisStepper& stepper = axis_stepper(axis);
+  uint8_t out = hold[axis].out;
+  if (out == HOLD_OFF) {
+    stepper.disableOutputs();
+    return;
+  }
+  if (hold_current_hook) {
+    hold_current_hook(axis, out == HOLD_REDUCED);
+  }
+  if (was != HOLD_OFF) {
+    return;
+  }
+#ifdef HW_STEP_BACKEND
+  if (axis == 0) {
+    stepper.enableOutputs();
+    return;
+  }
+#endif
+  stepper.energize();
+}
+
+static void coils_wake(uint8_t axis, uint32_t now){
+  uint8_t was = hold[axis].out;
+  if (hold_wake(hold[axis], now)) {
+    coils_apply(axis, was);
+  }
+}
+
+// Stepping, or due to step on this pass, in whatever mode is running.
+static bool axis_moving(uint8_t axis){
+  if (motion_mode == MOTION_JOG) {
+    return jog.axis[axis].speed != 0 || jog.axis[axis].target != 0;
+  } else if (motion_mode == MOTION_STREAM) {
+    return true;  // both axes follow the stream, even between targets
+  } else if (motion_mode == MOTION_CRUISE) {
+    const CruiseAxis& cruise = axis ? cruise_rotator : cruise_slider;
+    return cruise.rate || cruise.rate_rem;
+  } else if (motion_mode == MOTION_TABLE && table_interval[axis]) {
+    return true;
+  }
+#ifdef HW_STEP_BACKEND
+  if (axis == 0 && slider_hw.running) {
+    return true;
+  }
+#endif
+  return axis_stepper(axis).isRunning();
+}
+
+// Run before any stepping, so an axis starting a move on this pass is
+// energized at its current position first, with no wait for another pass.
+static void coils_update(){
+  uint32_t now = micros();
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    if (axis_moving(axis)) {
+      coils_wake(axis, now);
+      continue;
+    }
+    uint8_t was = hold[axis].out;
+    if (hold_idle(hold[axis], now)) {
+      coils_apply(axis, was);
+    }
+  }
+}
+
+// Position including the steps the hardware engine has made so far, which
+// only reach the stepper when its move ends.
+static long axis_steps_done(uint8_t axis){
+#ifdef HW_STEP_BACKEND
+  if (axis == 0 && slider_hw_dist != 0) {
+    long done = slider_hw_dist > 0 ? (long)slider_hw.steps : -(long)slider_hw.steps;
+    return slider_stepper.currentPosition() + done;
+  }
+#endif
+  return axis_stepper(axis).currentPosition();
+}
+
+// Lifetime counters: what moved since the last pass and the coil time.
+static void wear_track(){
+  uint32_t now = micros();
+  long position[2] = {axis_steps_done(0), axis_steps_done(1)};
+  uint64_t on_us[2] = {hold_on_us(hold[0], now), hold_on_us(hold[1], now)};
+  wear_update(wear, position, on_us, now);
+}
+
+static float axis_speed(uint8_t axis);
+
+// Which way the slider is going: -1, 0 or 1.
+static int8_t slider_dir(){
+#ifdef HW_STEP_BACKEND
+  if (slider_hw.running) {
+    return slider_hw_dist > 0 ? 1 : -1;
+  }
+#endif
+  float speed = axis_speed(0);
+  return speed > 0 ? 1 : (speed < 0 ? -1 : 0);
+}
 
 void limit_motors() {  
     digitalToggle(LED_RED);
+    limit_pin = digitalRead(TOP_LIMIT) == LOW ? TOP_LIMIT : BOTTOM_LIMIT;
+    limit_dir = slider_dir();
+    if (limit_hook) {
+      limit_hook(limit_pin);
+    }
+    if (motion_mode == MOTION_CRUISE) {
+      motion_mode = MOTION_POSITION;
+      motion_timer_stop();
+    }
+#ifdef HW_STEP_BACKEND
+    hw_step_stop(slider_hw);
+#endif
     slider_stepper.disableOutputs();
-    slider_stepper.moveTo(slider_stepper.currentPosition());
+    limit_pending = true;
 }
 
 
@@ -29,46 +351,801 @@ void setup_steppers(){
   attachInterrupt(digitalPinToInterrupt(TOP_LIMIT), limit_motors, FALLING);
   attachInterrupt(digitalPinToInterrupt(BOTTOM_LIMIT), limit_motors, FALLING);
 
-  // slider
-  slider_stepper.setMaxSpeed(900);
-  slider_stepper.setAcceleration(30);
-  slider_stepper.moveTo(0);
-  
-  rotator_stepper.setMaxSpeed(2000);
-  slider_stepper.setAcceleration(30);
   slider_stepper.moveTo(0);
+  rotator_stepper.moveTo(0);
+  hold_init(hold[0], 0, 0);
+  hold_init(hold[1], 0, 0);
+  config_defaults(motion_config);
+  motion_configure(motion_config);
+  motion_timer_begin();
 
-    digitalToggle(LED_RED);
-    delay(200);
+#ifdef HW_STEP_BACKEND
+  hw_step_init(slider_hw, &hw_step_nrf52_hal);
+  hw_step_nrf52_begin(SLIDER_STEP_PIN);
+#endif
+
+    // Boot indicator, the sketch toggles it back once it is ready
     digitalToggle(LED_RED);
 
 }
 
-void slide_dist(int dist){
+static void slide_apply(int dist){
+   if (motion_mode != MOTION_POSITION) {
+     return;
+   }
+#ifdef HW_STEP_BACKEND
+   if (slider_hw.running || dist == 0) {
+     return;
+   }
+   digitalWrite(SLIDER_DIR_PIN, dist > 0 ? HIGH : LOW);
+   hw_step_ramp_init(slider_ramp, abs(dist), slider_stepper.maxSpeed(),
+                     slider_stepper.acceleration());
+   slider_hw_dist = dist;
+   coils_wake(0, micros());
+   hw_step_start(slider_hw, hw_step_ramp_next, &slider_ramp);
+#else
    slider_stepper.moveTo(slider_stepper.currentPosition() + dist);
+#endif
 }
 
 
-void rotate_angle(int angle){
+static void rotate_apply(int angle){
+   if (motion_mode != MOTION_POSITION) {
+     return;
+   }
    rotator_stepper.moveTo(rotator_stepper.currentPosition() + angle);
 }
 
 
-void run_or_off(){
-  if (!slider_stepper.run()){
-    slider_stepper.disableOutputs();
-  } else {
-    slider_stepper.enableOutputs();
+// Refused only toward a limit switch that is still pressed.
+static bool jog_apply(int slider, int rotator, uint32_t rx_us){
+   if (estop_pending || estop_stopping) {
+     return true;
+   }
+   if (slider * limit_dir > 0 && digitalRead(limit_pin) == LOW) {
+     return false;
+   }
+#ifdef HW_STEP_BACKEND
+   if (slider_hw.running) {
+     return true;
+   }
+#endif
+   if (motion_mode != MOTION_JOG) {
+     // Drop any position move, jog takes over from the current speed of zero.
+     slider_stepper.moveTo(slider_stepper.currentPosition());
+     rotator_stepper.moveTo(rotator_stepper.currentPosition());
+     motion_mode = MOTION_JOG;
+   }
+   jog_command(jog, slider, rotator, micros(), rx_us);
+   return true;
+}
+
+uint32_t jog_latency_us(){
+  return jog.latency_us;
+}
+
+uint32_t jog_latency_max_us(){
+  return jog.latency_max_us;
+}
+
+// Back to position mode with both axes stopped, and the jog ramps back to the
+// jog acceleration if an emergency stop had taken them over.
+static void jog_end(){
+  slider_stepper.setSpeed(0);
+  rotator_stepper.setSpeed(0);
+  slider_stepper.moveTo(slider_stepper.currentPosition());
+  rotator_stepper.moveTo(rotator_stepper.currentPosition());
+  motion_mode = MOTION_POSITION;
+  if (estop_stopping) {
+    estop_stopping = false;
+    for (uint8_t axis = 0; axis < 2; axis++) {
+      jog.axis[axis].accel = base_jog_accel[axis] * power_scale / 1000.0f;
+    }
+  }
+}
+
+// Retarget speeds without planning a position move, AccelStepper only steps.
+static void jog_run(){
+  if (!jog_tick(jog, micros())) {
+    jog_end();
+    return;
+  }
+
+  slider_stepper.setSpeed(jog.axis[JOG_SLIDER].speed);
+  rotator_stepper.setSpeed(jog.axis[JOG_ROTATOR].speed);
+  jog_applied(jog, micros());
+
+  slider_stepper.runSpeed();
+  rotator_stepper.runSpeed();
+}
+
+static void record_start_apply(){
+  rec_start(recorder, slider_stepper.currentPosition(), rotator_stepper.currentPosition());
+  rec_next_us = micros() + REC_PERIOD_US;
+}
+
+static void record_stop_apply(){
+  rec_stop(recorder);
+}
+
+// Flash writes stall the CPU, so only while nothing is moving.
+bool record_save(){
+  return !motion_busy() && rec_save(recorder);
+}
+
+bool record_load(){
+  return !motion_busy() && rec_load(recorder);
+}
+
+uint32_t record_samples(){
+  return recorder.samples;
+}
+
+uint32_t record_bytes(){
+  return recorder.len;
+}
+
+uint32_t record_bytes_per_minute(){
+  return rec_bytes_per_minute(recorder);
+}
+
+uint32_t replay_error_max_us(){
+  return stream_err_max_us;
+}
+
+// Sampled on a fixed schedule, not on whenever the loop comes round.
+static void record_tick(){
+  if (!recorder.recording || (int32_t)(micros() - rec_next_us) < 0) {
+    return;
+  }
+  rec_next_us += REC_PERIOD_US;
+  rec_sample(recorder, slider_stepper.currentPosition(), rotator_stepper.currentPosition());
+}
+
+static void stream_start(StreamNext next, long slider, long rotator, uint32_t period_us){
+  stream_next = next;
+  stream_period_us = period_us;
+  stream_period_q16 = sync_period_q16(period_us, clock_skew_ppb);
+  stream_frac = 0;
+  stream_err_max_us = 0;
+  stream_homing = true;
+  slider_stepper.moveTo(slider);
+  rotator_stepper.moveTo(rotator);
+  motion_mode = MOTION_STREAM;
+}
+
+// Aim both axes at the next target, at the speed that lands them on time.
+static bool stream_target(){
+  int32_t slider, rotator;
+  if (!stream_next(slider, rotator)) {
+    return false;
+  }
+  float rate = 1000000.0f / stream_period_us;
+  slider_stepper.moveTo(slider);
+  slider_stepper.setSpeed((slider - slider_stepper.currentPosition()) * rate);
+  rotator_stepper.moveTo(rotator);
+  rotator_stepper.setSpeed((rotator - rotator_stepper.currentPosition()) * rate);
+  return true;
+}
+
+static void stream_run(){
+  if (stream_homing) {
+    bool slider_moving = slider_stepper.run();
+    bool rotator_moving = rotator_stepper.run();
+    if (!slider_moving && !rotator_moving) {
+      stream_homing = false;
+      stream_next_us = micros();
+    }
+    return;
+  }
+
+  uint32_t now = micros();
+  if ((int32_t)(now - stream_next_us) >= 0) {
+    if (now - stream_next_us > stream_err_max_us) {
+      stream_err_max_us = now - stream_next_us;
+    }
+    if (now - stream_next_us > WEAR_LATE_US) {
+      wear_missed(wear);
+    }
+    if (!stream_target()) {
+      motion_mode = MOTION_POSITION;
+      return;
+    }
+    uint64_t step = stream_period_q16 + stream_frac;
+    stream_next_us += (uint32_t)(step >> 16);
+    stream_frac = (uint16_t)step;
+  }
+  slider_stepper.runSpeedToPosition();
+  rotator_stepper.runSpeedToPosition();
+}
+
+static bool replay_next(int32_t& slider, int32_t& rotator){
+  return rec_play_next(player, slider, rotator);
+}
+
+static bool replay_apply(int speed_percent){
+  if (motion_mode != MOTION_POSITION || recorder.recording || recorder.samples == 0 ||
+      speed_percent <= 0) {
+    return false;
+  }
+  rec_play_start(player, recorder);
+  stream_start(replay_next, recorder.origin[0], recorder.origin[1],
+               (uint32_t)REC_PERIOD_US * 100 / speed_percent);
+  return true;
+}
+
+bool path_key(long pos, long angle, uint32_t t_ms){
+  return motion_mode != MOTION_STREAM && spline_add(path, pos, angle, t_ms);
+}
+
+void path_clear(){
+  if (motion_mode != MOTION_STREAM) {
+    spline_clear(path);
+  }
+}
+
+static bool path_next(int32_t& slider, int32_t& rotator){
+  return spline_next(path, slider, rotator);
+}
+
+static bool path_run_apply(){
+  if (motion_mode != MOTION_POSITION || !spline_start(path)) {
+    return false;
+  }
+  stream_start(path_next, path.keys[0].pos[0], path.keys[0].pos[1], SPLINE_TICK_US);
+  return true;
+}
+
+// Both axes advance on the same tick, so they stay phase locked.
+void motion_timer_tick(){
+  if (motion_mode != MOTION_CRUISE || estop_pending) {
+    return;
+  }
+  int8_t dir = cruise_tick(cruise_slider);
+  if (dir) {
+    slider_stepper.step_once(dir);
+  }
+  dir = cruise_tick(cruise_rotator);
+  if (dir) {
+    rotator_stepper.step_once(dir);
+  }
+}
+
+static bool cruise_apply(long slider_msps, long rotator_msps){
+  if (motion_mode != MOTION_POSITION && motion_mode != MOTION_CRUISE) {
+    return false;
+  }
+#ifdef HW_STEP_BACKEND
+  if (slider_hw.running) {
+    return false;
+  }
+#endif
+  motion_mode = MOTION_POSITION;
+  motion_timer_stop();
+  if (slider_msps == 0 && rotator_msps == 0) {
+    return true;
   }
+  if (!cruise_set(cruise_slider, slider_msps) || !cruise_set(cruise_rotator, rotator_msps)) {
+    return false;
+  }
+
+  slider_stepper.moveTo(slider_stepper.currentPosition());
+  rotator_stepper.moveTo(rotator_stepper.currentPosition());
+  // The timer steps before the next motion pass could energize them.
+  coils_wake(0, micros());
+  coils_wake(1, micros());
+  motion_timer_start();
+  motion_mode = MOTION_CRUISE;
+  return true;
+}
+
+void motion_set_limit_hook(LimitHook hook){
+  limit_hook = hook;
+}
+
+void motion_set_tick_hook(MotionTickHook hook){
+  tick_hook = hook;
+  if (hook) {
+    motion_timer_start();
+  } else if (motion_mode != MOTION_CRUISE) {
+    motion_timer_stop();
+  }
+}
+
+long motion_position(uint8_t axis){
+  return axis_stepper(axis).currentPosition();
+}
+
+long motion_target(uint8_t axis){
+  return axis_stepper(axis).targetPosition();
+}
+
+long motion_speed(uint8_t axis){
+  return (long)axis_stepper(axis).speed();
+}
+
+void motion_set_position(long slider, long rotator){
+  slider_stepper.setCurrentPosition(slider);
+  rotator_stepper.setCurrentPosition(rotator);
+  // Not travel, keep it out of the wear counters.
+  wear.position[0] = slider;
+  wear.position[1] = rotator;
+}
+
+bool motion_busy(){
+#ifdef HW_STEP_BACKEND
+  if (slider_hw.running) {
+    return true;
+  }
+#endif
+  return motion_mode != MOTION_POSITION || slider_stepper.isRunning() ||
+         rotator_stepper.isRunning();
+}
+
+// Compile relative moves for both axes with the current speed and acceleration.
+bool table_compile(long slider, long rotator){
+  if (motion_mode == MOTION_TABLE) {
+    return false;
+  }
+  long dist[STEP_TABLE_AXES] = {slider, rotator};
+  step_table_clear(table);
+  for (uint8_t axis = 0; axis < STEP_TABLE_AXES; axis++) {
+    HwStepRamp ramp;
+    AxisStepper& stepper = axis_stepper(axis);
+    hw_step_ramp_init(ramp, labs(dist[axis]), stepper.maxSpeed(), stepper.acceleration());
+    if (!step_table_compile(table, axis, dist[axis] < 0 ? -1 : 1, hw_step_ramp_next, &ramp)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool table_save(){
+  return !motion_busy() && step_table_save(table);
+}
+
+uint32_t table_bytes(){
+  return table.len;
+}
+
+uint32_t table_steps(uint8_t axis){
+  return table.axis[axis].steps;
+}
+
+uint32_t table_underruns(){
+  return table_stream[0].underruns + table_stream[1].underruns;
+}
+
+// Start the streams opened by table_run(), each step is just a table fetch.
+static bool table_run_apply(){
+  if (motion_mode != MOTION_POSITION) {
+    return false;
+  }
+#ifdef HW_STEP_BACKEND
+  if (slider_hw.running) {
+    return false;
+  }
+#endif
+
+  uint32_t now = micros();
+  for (uint8_t axis = 0; axis < STEP_TABLE_AXES; axis++) {
+    axis_stepper(axis).moveTo(axis_stepper(axis).currentPosition());
+    table_due_us[axis] = now;
+#ifdef HW_STEP_BACKEND
+    if (axis == 0) {
+      // The slider stream is drained by the hw_step engine, not by table_tick().
+      table_interval[axis] = 0;
+      continue;
+    }
+#endif
+    table_interval[axis] = step_table_next(&table_stream[axis]);
+  }
+#ifdef HW_STEP_BACKEND
+  digitalWrite(SLIDER_DIR_PIN, table_axes[0].dir > 0 ? HIGH : LOW);
+  slider_hw_dist = table_axes[0].dir;
+  coils_wake(0, now);
+  hw_step_start(slider_hw, step_table_next, &table_stream[0]);
+#endif
+  motion_mode = MOTION_TABLE;
+  return true;
+}
+
+void table_refill(){
+  if (motion_mode != MOTION_TABLE) {
+    return;
+  }
+  for (uint8_t axis = 0; axis < STEP_TABLE_AXES; axis++) {
+    step_table_refill(table_stream[axis]);
+  }
+}
+
+static void table_tick(){
+  uint32_t now = micros();
+  bool busy = false;
+  for (uint8_t axis = 0; axis < STEP_TABLE_AXES; axis++) {
+    if (table_interval[axis] == STEP_TABLE_NOT_READY) {
+      // The decoder ran dry; hold the axis until table_refill() catches up.
+      table_interval[axis] = step_table_next(&table_stream[axis]);
+      if (table_interval[axis] == STEP_TABLE_NOT_READY) {
+        busy = true;
+        continue;
+      }
+    }
+    if (!table_interval[axis] || (int32_t)(now - table_due_us[axis]) < 0) {
+      busy |= table_interval[axis] != 0;
+      continue;
+    }
+    axis_stepper(axis).step_once(table_axes[axis].dir);
+    if (now - table_due_us[axis] > WEAR_LATE_US) {
+      wear_missed(wear);
+    }
+    // Scheduled from the previous due time, loop latency never accumulates.
+    table_due_us[axis] += table_interval[axis];
+    table_interval[axis] = step_table_next(&table_stream[axis]);
+    busy = true;
+  }
+#ifdef HW_STEP_BACKEND
+  busy |= slider_hw.running;
+#endif
+  if (!busy) {
+    wear_missed(wear, table_underruns());
+    motion_mode = MOTION_POSITION;
+  }
+}
 
-  if (!rotator_stepper.run()){
-    rotator_stepper.disableOutputs();
-  } else {
-    rotator_stepper.enableOutputs();
+#ifdef HW_STEP_BACKEND
+// Book-keeping for a hardware driven slider move; the pulses need no CPU.
+static bool slider_hw_run(){
+  if (slider_hw.running) {
+    return true;
+  }
+  if (slider_hw_dist != 0) {
+    // Only the sign of slider_hw_dist matters, the engine counted the steps.
+    long dist = slider_hw_dist > 0 ? (long)slider_hw.steps : -(long)slider_hw.steps;
+    slider_stepper.setCurrentPosition(slider_stepper.currentPosition() + dist);
+    slider_hw_dist = 0;
   }
+  return false;
 }
+#endif
 
-void run_or_hold(){
-    slider_stepper.run();
-    rotator_stepper.run();
-}
\ No newline at end of file
+static bool configure_apply(const MotionConfig& config){
+  if (motion_busy()) {
+    return false;
+  }
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    axis_stepper(axis).setMaxSpeed(config.max_speed[axis]);
+    axis_stepper(axis).setAcceleration(config.accel[axis]);
+    jog_init(jog, axis, config.max_speed[axis], config.jog_accel[axis]);
+    base_max_speed[axis] = config.max_speed[axis];
+    base_accel[axis] = config.accel[axis];
+    base_jog_speed[axis] = config.max_speed[axis];
+    base_jog_accel[axis] = config.jog_accel[axis];
+    hold[axis].hold_ms = config.hold_ms[axis];
+    hold[axis].reduce_ms = config.reduce_ms[axis];
+  }
+  power_scale = 1000; // the new limits are unscaled, power_apply() catches up
+  return true;
+}
+
+void motion_set_power_scale(uint16_t permille){
+  power_scale_pending = permille;
+}
+
+uint16_t motion_power_scale(){
+  return power_scale;
+}
+
+// Applied from the motion loop so the steppers are only touched by one task.
+static void power_apply(){
+  uint16_t scale = power_scale_pending;
+  if (scale == power_scale) {
+    return;
+  }
+  power_scale = scale;
+  float k = scale / 1000.0f;
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    axis_stepper(axis).setMaxSpeed(base_max_speed[axis] * k);
+    axis_stepper(axis).setAcceleration(base_accel[axis] * k);
+    jog.axis[axis].max_speed = base_jog_speed[axis] * k;
+    jog.axis[axis].accel = base_jog_accel[axis] * k;
+  }
+}
+
+void motion_set_clock_skew(int32_t ppb){
+  clock_skew_ppb = ppb;
+}
+
+void motion_set_hold_current_hook(HoldCurrentHook hook){
+  hold_current_hook = hook;
+  hold[0].reducible = hook != NULL;
+  hold[1].reducible = hook != NULL;
+}
+
+const HoldAxis& motion_hold(uint8_t axis){
+  return hold[axis];
+}
+
+void motion_estop(uint32_t now_us){
+  if (!estop_pending) {
+    estop_request_us = now_us;
+    estop_pending = true;
+  }
+  estop_latched = true;
+}
+
+bool motion_estop_pending(){
+  return estop_pending;
+}
+
+bool motion_estopped(){
+  return estop_latched;
+}
+
+void motion_estop_ack(){
+  estop_latched = false;
+}
+
+uint32_t estop_count(){
+  return estop_stops;
+}
+
+uint32_t estop_latency_us(){
+  return estop_last_us;
+}
+
+uint32_t estop_latency_max_us(){
+  return estop_max_us;
+}
+
+// Signed speed of an axis whatever mode it is in.
+static float axis_speed(uint8_t axis){
+  if (motion_mode == MOTION_CRUISE) {
+    CruiseAxis& cruise = axis ? cruise_rotator : cruise_slider;
+    return cruise.dir * (float)cruise.rate / CRUISE_ONE * CRUISE_TICK_HZ;
+  } else if (motion_mode == MOTION_TABLE) {
+    uint32_t interval = table_interval[axis];
+    if (!interval || interval == STEP_TABLE_NOT_READY) {
+      return 0;
+    }
+    return table_axes[axis].dir * 1e6f / interval;
+  }
+  return axis_stepper(axis).speed();
+}
+
+// Drop the running mode and ramp both axes down through the jog ramps, which
+// take over from any speed.  A hardware slider move ramps itself down at the
+// same rate instead, its speed is not the stepper's (which stays 0).
+static void estop_apply(){
+  uint32_t now = micros();
+  float speed[2] = {axis_speed(0), axis_speed(1)};
+#ifdef HW_STEP_BACKEND
+  if (slider_hw.running) {
+    hw_step_ramp_stop(slider_ramp, ESTOP_DECEL);
+  }
+#endif
+  motion_mode = MOTION_POSITION;
+  motion_timer_stop();
+  estop_pending = false;
+
+  jog_stop(jog, speed, ESTOP_DECEL, now);
+  estop_stopping = true;
+  motion_mode = MOTION_JOG;
+
+  estop_applied_us = now;
+  estop_stops++;
+  estop_last_us = now - estop_request_us;
+  if (estop_last_us > estop_max_us) {
+    estop_max_us = estop_last_us;
+  }
+}
+
+// Checked first on every motion pass.
+static void estop_poll(){
+  if (estop_pending) {
+    estop_apply();
+  } else if (estop_latched && !estop_stopping &&
+             micros() - estop_applied_us > ESTOP_LATCH_US) {
+    estop_latched = false;
+  }
+}
+
+// The interrupt stopped the hardware engine and cruise and switched the
+// slider off; drop whatever else is running, before it steps again, and
+// leave the slider where it is.
+static void limit_poll(){
+  if (!limit_pending) {
+    return;
+  }
+  limit_pending = false;
+  if (motion_mode == MOTION_TABLE) {
+    for (uint8_t axis = 0; axis < STEP_TABLE_AXES; axis++) {
+      table_interval[axis] = 0;
+    }
+    motion_mode = MOTION_POSITION;
+  } else if (motion_mode == MOTION_JOG) {
+    for (uint8_t axis = 0; axis < JOG_AXES; axis++) {
+      jog.axis[axis].target = 0;
+      jog.axis[axis].speed = 0;
+    }
+    jog.active = false;
+    jog_end();
+  } else if (motion_mode == MOTION_STREAM) {
+    // A path or replay ends here, it would only aim at the next target.
+    stream_homing = false;
+    rotator_stepper.setSpeed(0);
+    rotator_stepper.moveTo(rotator_stepper.currentPosition());
+    motion_mode = MOTION_POSITION;
+  }
+#ifdef HW_STEP_BACKEND
+  slider_hw_run();
+#endif
+  slider_stepper.setCurrentPosition(slider_stepper.currentPosition());
+  hold_release(hold[0], micros());
+  wear_limit(wear);
+}
+
+// Keep the earliest of the deadlines seen so far.
+static void due_min(bool& any, uint32_t& due_us, uint32_t t){
+  if (!any || (int32_t)(t - due_us) < 0) {
+    due_us = t;
+  }
+  any = true;
+}
+
+bool motion_next_step(uint32_t& due_us){
+  bool any = false;
+  if (estop_pending || motion_mode == MOTION_CRUISE) {
+    return false;  // applied, or stepped, on the timer tick
+  }
+  if (motion_mode == MOTION_TABLE) {
+    for (uint8_t axis = 0; axis < STEP_TABLE_AXES; axis++) {
+      uint32_t interval = table_interval[axis];
+      if (interval && interval != STEP_TABLE_NOT_READY) {
+        due_min(any, due_us, table_due_us[axis]);
+      }
+    }
+    return any;
+  }
+  bool streaming = motion_mode == MOTION_STREAM && !stream_homing;
+  if (streaming) {
+    due_min(any, due_us, stream_next_us);
+  }
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    AxisStepper& stepper = axis_stepper(axis);
+#ifdef HW_STEP_BACKEND
+    if (axis == 0 && motion_mode == MOTION_POSITION) {
+      continue;  // the hw_step engine makes these steps
+    }
+#endif
+    uint32_t t;
+    if ((!streaming || stepper.distanceToGo() != 0) && stepper.step_due(t)) {
+      due_min(any, due_us, t);
+    }
+  }
+  return any;
+}
+
+// One motion pass: apply a stop, a limit switch trip or new speed limits, set
+// the coils, count what the
+// last pass moved, then step whatever is running.
+void motion_run(){
+  estop_poll();
+  limit_poll();
+  power_apply();
+  record_tick();
+  coils_update();
+  wear_track();
+  if (motion_mode == MOTION_TABLE) {
+    table_tick();
+#ifdef HW_STEP_BACKEND
+    slider_hw_run();
+#endif
+    return;
+  } else if (motion_mode == MOTION_CRUISE) {
+    // Steps come from the motion timer.
+    return;
+  } else if (motion_mode == MOTION_JOG) {
+    jog_run();
+    return;
+  } else if (motion_mode == MOTION_STREAM) {
+    stream_run();
+    return;
+  }
+
+#ifdef HW_STEP_BACKEND
+  slider_hw_run();
+#else
+  slider_stepper.run();
+#endif
+  rotator_stepper.run();
+}
+
+
+void motion_set_request_hook(MotionRequestHook hook){
+  request_hook = hook;
+}
+
+static bool motion_request(uint8_t op, int32_t a = 0, int32_t b = 0,
+                           const MotionConfig* config = NULL, uint32_t rx_us = 0){
+  MotionRequest request = {op, {a, b}, config, rx_us};
+  return request_hook ? request_hook(request) : motion_request_run(request);
+}
+
+bool motion_request_run(const MotionRequest& request){
+  switch (request.op) {
+    case MOTION_REQ_SLIDE:
+      slide_apply(request.arg[0]);
+      return true;
+    case MOTION_REQ_ROTATE:
+      rotate_apply(request.arg[0]);
+      return true;
+    case MOTION_REQ_JOG:
+      return jog_apply(request.arg[0], request.arg[1], request.rx_us);
+    case MOTION_REQ_RECORD_START:
+      record_start_apply();
+      return true;
+    case MOTION_REQ_RECORD_STOP:
+      record_stop_apply();
+      return true;
+    case MOTION_REQ_REPLAY:
+      return replay_apply(request.arg[0]);
+    case MOTION_REQ_PATH_RUN:
+      return path_run_apply();
+    case MOTION_REQ_CRUISE:
+      return cruise_apply(request.arg[0], request.arg[1]);
+    case MOTION_REQ_TABLE_RUN:
+      return table_run_apply();
+    case MOTION_REQ_CONFIGURE:
+      return configure_apply(*request.config);
+  }
+  return false;
+}
+
+void slide_dist(int dist){
+  motion_request(MOTION_REQ_SLIDE, dist);
+}
+
+void rotate_angle(int angle){
+  motion_request(MOTION_REQ_ROTATE, angle);
+}
+
+bool jog_velocity(int slider, int rotator, uint32_t rx_us){
+  return motion_request(MOTION_REQ_JOG, slider, rotator, NULL, rx_us);
+}
+
+void record_start(){
+  motion_request(MOTION_REQ_RECORD_START);
+}
+
+void record_stop(){
+  motion_request(MOTION_REQ_RECORD_STOP);
+}
+
+bool replay_start(int speed_percent){
+  return motion_request(MOTION_REQ_REPLAY, speed_percent);
+}
+
+bool path_run(){
+  return motion_request(MOTION_REQ_PATH_RUN);
+}
+
+bool cruise_start(long slider_msps, long rotator_msps){
+  return motion_request(MOTION_REQ_CRUISE, slider_msps, rotator_msps);
+}
+
+bool motion_configure(const MotionConfig& config){
+  return motion_request(MOTION_REQ_CONFIGURE, 0, 0, &config);
+}
+
+// Opened here, in the caller's task: the file is read while the motors are
+// still idle, the motion task only starts the streams.
+bool table_run(){
+  if (motion_mode != MOTION_POSITION || !step_table_open(table_axes)) {
+    return false;
+  }
+  for (uint8_t axis = 0; axis < STEP_TABLE_AXES; axis++) {
+    step_table_stream_start(table_stream[axis], table_axes[axis], step_table_file_read, NULL);
+  }
+  return motion_request(MOTION_REQ_TABLE_RUN);
+}
@@ -1,8 +1,144 @@
 // motors.h
 
+#include <stdint.h>
+
+#include "config.h"
+#include "hold.h"
+
 void setup_steppers();
-void run_or_off();
-void run_or_hold();
+void motion_run();
+
+// Apply speed/acceleration limits, e.g. a loaded MotionConfig.
+// @return false while moving
+bool motion_configure(const MotionConfig& config);
+
+// axis 0 = slider, 1 = rotator
+long motion_position(uint8_t axis);
+long motion_target(uint8_t axis);
+long motion_speed(uint8_t axis);  // steps/s, signed
+bool motion_busy();
+
+// Put the axes at these positions without moving them, e.g. where an event
+// log started.  Only while idle.
+void motion_set_position(long slider, long rotator);
+
+// Scale maximum speed and acceleration, permille of the values set up in
+// setup_steppers(), for moves, jog, replay and paths (cruise runs at the rate
+// it was given).  Takes effect on the next motion_run().
+void motion_set_power_scale(uint16_t permille);
+uint16_t motion_power_scale();
+
+// Coils are switched on and off per axis by the hold policy in hold.h, with
+// the times from MotionConfig.  Drivers with a current setting can install a
+// hook, which enables reduced current holding: it is called with reduced true
+// when an idle axis drops to reduced current and false when it goes back to
+// full.  Called from the motion task.
+typedef void (*HoldCurrentHook)(uint8_t axis, bool reduced);
+void motion_set_hold_current_hook(HoldCurrentHook hook);
+const HoldAxis& motion_hold(uint8_t axis);
+
+// Emergency stop, safe to call from any task or interrupt.  The next motion
+// pass drops whatever is running (jog, stream, table, cruise, position move)
+// and ramps both axes to zero at ESTOP_DECEL.  Until motion_estop_ack() the
+// stop stays latched, so lines queued before it cannot start a new move.
+#define ESTOP_DECEL 20000       // steps/s^2
+#define ESTOP_LATCH_US 1000000  // latch clears by itself this long after the stop
+void motion_estop(uint32_t now_us);
+bool motion_estop_pending();  // requested, not yet applied by a pass
+bool motion_estopped();
+void motion_estop_ack();
+uint32_t estop_count();
+uint32_t estop_latency_us();      // request to deceleration start, last stop
+uint32_t estop_latency_max_us();
+
+// Requests that change what the motors do: moves, jog, record, replay,
+// paths, cruise, table runs and limits.  Commands run in the command task but
+// the steppers belong to the motion task, so with a request hook installed
+// each of these calls is handed to the hook, which has the motion task run
+// it with motion_request_run() and returns the result.  Without a hook (the
+// simulator, setup()) they run at once.  E-stop and the power scale are not
+// requests, they are latched for the next pass.
+enum MotionRequestOp : uint8_t {
+  MOTION_REQ_SLIDE,
+  MOTION_REQ_ROTATE,
+  MOTION_REQ_JOG,
+  MOTION_REQ_RECORD_START,
+  MOTION_REQ_RECORD_STOP,
+  MOTION_REQ_REPLAY,
+  MOTION_REQ_PATH_RUN,
+  MOTION_REQ_CRUISE,
+  MOTION_REQ_TABLE_RUN,
+  MOTION_REQ_CONFIGURE,
+};
+
+struct MotionRequest {
+  uint8_t op;
+  int32_t arg[2];
+  const MotionConfig* config;  // MOTION_REQ_CONFIGURE, the caller waits
+  uint32_t rx_us;              // MOTION_REQ_JOG, when the line arrived
+};
+
+typedef bool (*MotionRequestHook)(const MotionRequest& request);
+void motion_set_request_hook(MotionRequestHook hook);
+bool motion_request_run(const MotionRequest& request);
 
 void slide_dist(int dist);
-void rotate_angle(int angle); 
\ No newline at end of file
+void rotate_angle(int angle);
+
+// rx_us is when the line arrived, for jog_latency_us().  False toward a
+// pressed limit switch.
+bool jog_velocity(int slider, int rotator, uint32_t rx_us);
+uint32_t jog_latency_us();
+uint32_t jog_latency_max_us(); 
+void record_start();
+void record_stop();
+bool record_save();
+bool record_load();
+bool replay_start(int speed_percent);
+uint32_t record_samples();
+uint32_t record_bytes();
+uint32_t record_bytes_per_minute();
+uint32_t replay_error_max_us();
+
+bool path_key(long pos, long angle, uint32_t t_ms);
+void path_clear();
+bool path_run();
+
+// How much faster our clock runs than the central's (clock_sync.h).  Streams
+// started afterwards (replay, paths) space their samples on the central's
+// clock, so sliders started together stay together.
+void motion_set_clock_skew(int32_t ppb);
+
+// milli-steps per second, both zero stops
+bool cruise_start(long slider_msps, long rotator_msps);
+// Called from the motion timer interrupt, or by the simulator.
+void motion_timer_tick();
+
+// Called from the motion timer interrupt after each tick, e.g. to wake the
+// motion task, and at the time given to motion_wake_at().  While a hook is
+// set the timer runs continuously.
+typedef void (*MotionTickHook)();
+void motion_set_tick_hook(MotionTickHook hook);
+
+// Earliest time the next motion pass has a step, or a stream sample, due;
+// false if none is (idle, cruise).  May be in the past if it is due now.
+// The tick alone would put every step on its 200 us grid.
+bool motion_next_step(uint32_t& due_us);
+
+// Have the tick hook called at due_us as well, if it comes before the next
+// tick.  A no-op in the simulator, which schedules its own passes.
+void motion_wake_at(uint32_t due_us);
+
+// Called from the limit switch interrupt with the pin that tripped.
+typedef void (*LimitHook)(uint8_t pin);
+void motion_set_limit_hook(LimitHook hook);
+
+bool table_compile(long slider, long rotator);
+bool table_save();
+bool table_run();
+// Load the table chunks the run has used up.  Flash reads, so called by
+// the command task (or the simulator loop), never by the motion pass.
+void table_refill();
+uint32_t table_bytes();
+uint32_t table_steps(uint8_t axis);
+uint32_t table_underruns();
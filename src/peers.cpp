@@ -0,0 +1,271 @@
+// peers.cpp
+
+#include "peers.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+#include "event_log.h"
+#include "motors.h"
+
+#define PEER_FRAME_MAX 256
+
+Peers ble_peers;
+
+static uint8_t frame[PEER_FRAME_MAX];
+static size_t frame_len;
+
+template <uint16_t N>
+static uint16_t ring_used(const PeerRing<N>& ring) {
+  return (uint16_t)(ring.head - ring.tail);
+}
+
+template <uint16_t N>
+static bool ring_put(PeerRing<N>& ring, const uint8_t* data, size_t len) {
+  if (len > (size_t)(N - ring_used(ring))) {
+    return false;
+  }
+  uint16_t head = ring.head;
+  for (size_t i = 0; i < len; i++) {
+    ring.buf[(head + i) & (N - 1)] = data[i];
+  }
+  __sync_synchronize();  // bytes before head, the consumer is another task
+  ring.head = head + len;
+  return true;
+}
+
+// Contiguous bytes at the tail, up to max.
+template <uint16_t N>
+static size_t ring_peek(const PeerRing<N>& ring, const uint8_t*& data, size_t max) {
+  uint16_t at = ring.tail & (N - 1);
+  size_t n = ring_used(ring);
+  if (n > (size_t)(N - at)) {
+    n = N - at;
+  }
+  data = ring.buf + at;
+  return n < max ? n : max;
+}
+
+template <uint16_t N>
+static void ring_skip(PeerRing<N>& ring, size_t len) {
+  __sync_synchronize();
+  ring.tail = ring.tail + len;
+}
+
+void peers_init(Peers& peers) {
+  memset(&peers, 0, sizeof(peers));
+  peers.owner = PEER_NONE;
+}
+
+uint8_t peers_connect(Peers& peers, uint16_t conn, uint32_t now_us) {
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    Peer& peer = peers.peer[id];
+    if (!peer.connected) {
+      memset(&peer, 0, sizeof(peer));
+      peer.conn = conn;
+      peer.chunk = PEER_CHUNK_MIN;
+      link_init(peer.link);
+      peer.link.last_rx_us = now_us;
+      peer.connected = true;
+      evlog_link(event_log, EVLOG_CONNECT, id, now_us);
+      return id;
+    }
+  }
+  return PEER_NONE;
+}
+
+void peers_disconnect(Peers& peers, uint16_t conn, uint32_t now_us) {
+  uint8_t id = peers_find(peers, conn);
+  if (id == PEER_NONE) {
+    return;
+  }
+  evlog_link(event_log, EVLOG_DISCONNECT, id, now_us);
+  peers.peer[id].connected = false;
+  peers.peer[id].watching = false;
+  if (peers.owner == id) {
+    peers.owner = PEER_NONE;
+  }
+}
+
+uint8_t peers_find(const Peers& peers, uint16_t conn) {
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    if (peers.peer[id].connected && peers.peer[id].conn == conn) {
+      return id;
+    }
+  }
+  return PEER_NONE;
+}
+
+uint8_t peers_count(const Peers& peers) {
+  uint8_t count = 0;
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    count += peers.peer[id].connected;
+  }
+  return count;
+}
+
+void peers_set_chunk(Peers& peers, uint8_t id, uint16_t chunk) {
+  if (id < PEER_MAX) {
+    peers.peer[id].chunk = chunk < PEER_CHUNK_MIN ? PEER_CHUNK_MIN : chunk;
+  }
+}
+
+size_t peers_rx(Peers& peers, uint8_t id, const uint8_t* data, size_t len) {
+  if (id >= PEER_MAX) {
+    return 0;
+  }
+  Peer& peer = peers.peer[id];
+  uint32_t now_us = micros();
+  for (size_t i = 0; i < len; i++) {
+    if (data[i] == 'x' && !peer.rx_mid_line) {
+      motion_estop(now_us);
+    }
+    peer.rx_mid_line = data[i] != '\n' && data[i] != '\r';
+  }
+  size_t space = PEER_RX_BYTES - ring_used(peer.rx);
+  size_t n = len < space ? len : space;
+  if ((uint8_t)(peer.stamp_head - peer.stamp_tail) == PEER_RX_STAMPS) {
+    n = 0;
+  }
+  if (n > 0) {
+    PeerStamp& stamp = peer.rx_stamp[peer.stamp_head & (PEER_RX_STAMPS - 1)];
+    stamp.end = peer.rx.head + n;
+    stamp.rx_us = now_us;
+    peer.stamp_head = peer.stamp_head + 1;  // ring_put() publishes it with the bytes
+    ring_put(peer.rx, data, n);
+  }
+  peer.stats.rx_dropped += len - n;
+  return n;
+}
+
+void peers_poll(Peers& peers, uint32_t now_us) {
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    Peer& peer = peers.peer[id];
+    const uint8_t* data;
+    size_t n;
+    while ((n = ring_peek(peer.rx, data, PEER_RX_BYTES)) > 0) {
+      const PeerStamp& stamp = peer.rx_stamp[peer.stamp_tail & (PEER_RX_STAMPS - 1)];
+      size_t left = (uint16_t)(stamp.end - peer.rx.tail);
+      if (n > left) {
+        n = left;
+      }
+      link_rx(peer.link, n, now_us);
+      evlog_input(event_log, EVLOG_BLE, data, n, stamp.rx_us, id);
+      peer.stats.rx_bytes += n;
+      for (size_t i = 0; i < n; i++) {
+        if (data[i] == '\n') {
+          peer.stats.lines++;
+        }
+        if (!command_feed(peer.line, id, data[i], stamp.rx_us)) {
+          Serial.write(data[i]);
+        }
+      }
+      ring_skip(peer.rx, n);
+      if (peer.rx.tail == stamp.end) {
+        peer.stamp_tail = peer.stamp_tail + 1;
+      }
+    }
+  }
+}
+
+bool peers_write(Peers& peers, uint8_t id, const uint8_t* buf, size_t len) {
+  if (id >= PEER_MAX || !peers.peer[id].connected) {
+    return false;
+  }
+  Peer& peer = peers.peer[id];
+  if (!ring_put(peer.tx, buf, len)) {
+    peer.stats.tx_dropped++;
+    return false;
+  }
+  return true;
+}
+
+void peers_send(Peers& peers, PeerSend send) {
+  bool more = true;
+  while (more) {
+    more = false;
+    for (uint8_t i = 0; i < PEER_MAX; i++) {
+      uint8_t id = (peers.next_send + i) % PEER_MAX;
+      Peer& peer = peers.peer[id];
+      const uint8_t* data;
+      size_t n = ring_peek(peer.tx, data, peer.chunk);
+      if (n == 0 || !peer.connected) {
+        continue;
+      }
+      size_t sent = send(peer.conn, data, n);
+      if (sent == 0) {
+        continue;
+      }
+      ring_skip(peer.tx, sent);
+      peer.stats.tx_bytes += sent;
+      more = true;
+    }
+    peers.next_send = (peers.next_send + 1) % PEER_MAX;
+  }
+}
+
+bool peers_claim(Peers& peers, uint8_t id, bool busy, uint32_t now_us) {
+  uint8_t owner = peers.owner;
+  bool held = owner < PEER_MAX && owner != id && peers.peer[owner].connected &&
+              (busy || now_us - peers.owner_us < PEER_OWNER_IDLE_US);
+  if (held) {
+    if (id < PEER_MAX) {
+      peers.peer[id].stats.refused++;
+    }
+    return false;
+  }
+  peers.owner = id;
+  peers.owner_us = now_us;
+  return true;
+}
+
+void peers_release(Peers& peers, uint8_t id) {
+  if (peers.owner == id) {
+    peers.owner = PEER_NONE;
+  }
+}
+
+bool peers_watch(Peers& peers, uint8_t id, bool on) {
+  if (id >= PEER_MAX || !peers.peer[id].connected) {
+    return false;
+  }
+  peers.peer[id].watching = on;
+  return true;
+}
+
+static void frame_sink(const uint8_t* buf, size_t len) {
+  if (frame_len + len <= PEER_FRAME_MAX) {
+    memcpy(frame + frame_len, buf, len);
+  }
+  frame_len += len;
+}
+
+void peers_telemetry(Peers& peers, uint32_t now_us) {
+  if ((int32_t)(now_us - peers.next_telemetry_us) < 0) {
+    return;
+  }
+  peers.next_telemetry_us = now_us + PEER_TELEMETRY_US;
+
+  bool watched = false;
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    watched |= peers.peer[id].connected && peers.peer[id].watching;
+  }
+  if (!watched) {
+    return;
+  }
+
+  RespWriter w;
+  resp_init(w, frame_sink, RESP_CHUNK_MAX);
+  frame_len = 0;
+  command_status(w);
+  resp_flush(w);
+  if (frame_len > PEER_FRAME_MAX) {
+    return;
+  }
+  peers.telemetry_frames++;
+  for (uint8_t id = 0; id < PEER_MAX; id++) {
+    if (peers.peer[id].watching && peers_write(peers, id, frame, frame_len)) {
+      peers.telemetry_sends++;
+    }
+  }
+}
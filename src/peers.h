@@ -0,0 +1,148 @@
+// peers.h
+//
+// Several centrals connected at once, e.g. the phone app and a handheld
+// remote.  Each connection gets its own RX ring (filled from the BLE task),
+// its own command line, a TX ring that is sent at that connection's MTU, and
+// its own connection interval policy.
+//
+// Control: query commands ("s", "...?") are open to every peer, but only one
+// peer at a time may run commands that move or reconfigure the slider.  The
+// first peer to send one takes control, and keeps it while connected and
+// either moving or active within PEER_OWNER_IDLE_US; "release" hands it back.
+// Serial and the simulator script are local and never refused.
+//
+// Stop: an 'x' at the start of a line is acted on as it arrives in
+// peers_rx(), ahead of anything queued, from any peer.
+//
+// Telemetry: peers that sent "watch:1" get the status object every
+// PEER_TELEMETRY_US.  It is serialized once and the same bytes are queued to
+// each subscriber.
+//
+// Plain C++ so the simulator can drive it with mock connections.
+
+#ifndef PEERS_H
+#define PEERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ble_link.h"
+#include "commands.h"
+
+#define PEER_MAX 3
+#define PEER_RX_BYTES 256             // power of two
+#define PEER_RX_STAMPS 16             // frames queued per peer, power of two
+#define PEER_TX_BYTES 1024            // power of two
+#define PEER_OWNER_IDLE_US 10000000   // control lapses after 10 s without use
+#define PEER_TELEMETRY_US 500000
+#define PEER_CHUNK_MIN 20             // default ATT MTU less the header
+#define PEER_NONE 0xff
+
+// Bytes the connection took, 0 if it has no notification buffer free.
+typedef size_t (*PeerSend)(uint16_t conn, const uint8_t* buf, size_t len);
+
+// Single producer, single consumer; head and tail run free and wrap.
+template <uint16_t N>
+struct PeerRing {
+  uint8_t buf[N];
+  volatile uint16_t head;  // written by the producer
+  volatile uint16_t tail;  // written by the consumer
+};
+
+// When a received frame arrived; its bytes run up to end in the RX ring.
+struct PeerStamp {
+  uint16_t end;
+  uint32_t rx_us;
+};
+
+struct PeerStats {
+  uint32_t rx_bytes;
+  uint32_t tx_bytes;
+  uint32_t rx_dropped;  // RX ring or its stamps full
+  uint32_t tx_dropped;  // TX ring full, reply or telemetry lost
+  uint32_t refused;     // control commands while another peer had control
+  uint32_t lines;
+};
+
+struct Peer {
+  volatile bool connected;
+  uint16_t conn;
+  uint16_t chunk;       // notification payload, MTU - 3
+  bool watching;
+  bool rx_mid_line;     // BLE task side: last byte queued was not '\n'
+  PeerRing<PEER_RX_BYTES> rx;
+  PeerStamp rx_stamp[PEER_RX_STAMPS];
+  volatile uint8_t stamp_head;  // written by the BLE task
+  volatile uint8_t stamp_tail;  // written by peers_poll()
+  PeerRing<PEER_TX_BYTES> tx;
+  CommandLine line;
+  LinkPolicy link;
+  PeerStats stats;
+};
+
+struct Peers {
+  Peer peer[PEER_MAX];
+  volatile uint8_t owner;   // PEER_NONE if nobody has control
+  uint32_t owner_us;        // last control command from the owner
+  uint8_t next_send;        // round-robin start for peers_send()
+  uint32_t next_telemetry_us;
+  uint32_t telemetry_frames;  // serialized once each
+  uint32_t telemetry_sends;   // copies queued to subscribers
+};
+
+extern Peers ble_peers;
+
+void peers_init(Peers& peers);
+
+/**
+ * Connections come and go from the BLE task, and are logged with the id.
+ * @return the new peer's id, or PEER_NONE if all slots are taken
+ */
+uint8_t peers_connect(Peers& peers, uint16_t conn, uint32_t now_us);
+void peers_disconnect(Peers& peers, uint16_t conn, uint32_t now_us);
+
+/** @return the id for a connection handle, or PEER_NONE */
+uint8_t peers_find(const Peers& peers, uint16_t conn);
+uint8_t peers_count(const Peers& peers);
+
+// Notification size once the MTU exchange is done.
+void peers_set_chunk(Peers& peers, uint8_t id, uint16_t chunk);
+
+/**
+ * Queue received bytes; called from the BLE task.  An 'x' starting a line
+ * requests the emergency stop straight away.  The frame is stamped with its
+ * arrival time, which its lines carry to command_rx_us().
+ * @return bytes queued, the rest were dropped
+ */
+size_t peers_rx(Peers& peers, uint8_t id, const uint8_t* data, size_t len);
+
+// Move every peer's received bytes into its command line, logging them with
+// their arrival time and dispatching complete lines with the peer as the
+// source.
+void peers_poll(Peers& peers, uint32_t now_us);
+
+/**
+ * Queue reply or telemetry bytes for one peer.
+ * @return false if they did not fit and were dropped
+ */
+bool peers_write(Peers& peers, uint8_t id, const uint8_t* buf, size_t len);
+
+// Send what the TX rings hold, a chunk per peer in turn until each is empty
+// or its connection is full.
+void peers_send(Peers& peers, PeerSend send);
+
+/**
+ * Give id control if it has it already or nobody else does.
+ * @param busy true while the motors are moving, which keeps the owner's claim
+ */
+bool peers_claim(Peers& peers, uint8_t id, bool busy, uint32_t now_us);
+void peers_release(Peers& peers, uint8_t id);
+
+/** @return false if id is not a connected peer */
+bool peers_watch(Peers& peers, uint8_t id, bool on);
+
+// Serialize the status object once if it is due and someone is watching,
+// and queue it to every watcher.
+void peers_telemetry(Peers& peers, uint32_t now_us);
+
+#endif  // PEERS_H
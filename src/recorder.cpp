@@ -0,0 +1,181 @@
+// recorder.cpp
+
+#include "recorder.h"
+
+#include "varint.h"
+
+void rec_start(Recorder& rec, int32_t slider, int32_t rotator) {
+  rec.len = 0;
+  rec.samples = 0;
+  rec.origin[0] = rec.last[0] = slider;
+  rec.origin[1] = rec.last[1] = rotator;
+  rec.full = false;
+  rec.recording = true;
+}
+
+bool rec_sample(Recorder& rec, int32_t slider, int32_t rotator) {
+  if (!rec.recording) {
+    return false;
+  }
+
+  size_t space = REC_BUF_BYTES - rec.len;
+  size_t a = varint_put(rec.buf + rec.len, space, zigzag_encode(slider - rec.last[0]));
+  size_t b = a ? varint_put(rec.buf + rec.len + a, space - a,
+                            zigzag_encode(rotator - rec.last[1]))
+               : 0;
+  if (!b) {
+    rec.full = true;
+    rec.recording = false;
+    return false;
+  }
+
+  rec.len += a + b;
+  rec.samples++;
+  rec.last[0] = slider;
+  rec.last[1] = rotator;
+  return true;
+}
+
+void rec_stop(Recorder& rec) {
+  rec.recording = false;
+}
+
+uint32_t rec_duration_us(const Recorder& rec) {
+  return rec.samples * REC_PERIOD_US;
+}
+
+uint32_t rec_bytes_per_minute(const Recorder& rec) {
+  if (rec.samples == 0) {
+    return 0;
+  }
+  return (uint64_t)rec.len * 60000000ULL / rec_duration_us(rec);
+}
+
+void rec_play_start(RecPlayer& player, const Recorder& rec) {
+  player.rec = &rec;
+  player.pos = 0;
+  player.index = 0;
+  player.cur[0] = rec.origin[0];
+  player.cur[1] = rec.origin[1];
+}
+
+bool rec_play_next(RecPlayer& player, int32_t& slider, int32_t& rotator) {
+  const Recorder& rec = *player.rec;
+  if (player.index >= rec.samples) {
+    return false;
+  }
+
+  uint32_t ds, dr;
+  size_t a = varint_get(rec.buf + player.pos, rec.len - player.pos, &ds);
+  size_t b = a ? varint_get(rec.buf + player.pos + a, rec.len - player.pos - a, &dr) : 0;
+  if (!b) {
+    return false;
+  }
+
+  player.pos += a + b;
+  player.index++;
+  slider = player.cur[0] += zigzag_decode(ds);
+  rotator = player.cur[1] += zigzag_decode(dr);
+  return true;
+}
+
+struct RecFileHeader {
+  uint32_t magic;
+  uint32_t samples;
+  int32_t origin[2];
+  uint16_t len;
+};
+
+#define REC_MAGIC 0x31434552  // "REC1"
+
+static bool rec_apply_header(Recorder& rec, const RecFileHeader& header) {
+  rec.samples = header.samples;
+  rec.len = header.len;
+  rec.origin[0] = rec.last[0] = header.origin[0];
+  rec.origin[1] = rec.last[1] = header.origin[1];
+  rec.full = false;
+  return true;
+}
+
+#ifdef ARDUINO
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+
+using namespace Adafruit_LittleFS_Namespace;
+
+bool rec_save(const Recorder& rec) {
+  if (rec.recording || !InternalFS.begin()) {
+    return false;
+  }
+  InternalFS.remove(REC_FILE);
+  File file = InternalFS.open(REC_FILE, FILE_O_WRITE);
+  if (!file) {
+    return false;
+  }
+
+  RecFileHeader header = {REC_MAGIC, rec.samples, {rec.origin[0], rec.origin[1]}, rec.len};
+  bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+            file.write(rec.buf, rec.len) == rec.len;
+  file.close();
+  return ok;
+}
+
+bool rec_load(Recorder& rec) {
+  if (rec.recording || !InternalFS.begin()) {
+    return false;
+  }
+  File file = InternalFS.open(REC_FILE, FILE_O_READ);
+  if (!file) {
+    return false;
+  }
+
+  RecFileHeader header;
+  bool ok = file.read(&header, sizeof(header)) == sizeof(header) &&
+            header.magic == REC_MAGIC && header.len <= REC_BUF_BYTES &&
+            file.read(rec.buf, header.len) == header.len;
+  file.close();
+  if (!ok) {
+    rec.samples = 0;
+    rec.len = 0;
+    return false;
+  }
+  return rec_apply_header(rec, header);
+}
+#else
+#include <stdio.h>
+
+bool rec_save(const Recorder& rec) {
+  if (rec.recording) {
+    return false;
+  }
+  FILE* file = fopen(REC_FILE + 1, "wb");
+  if (!file) {
+    return false;
+  }
+  RecFileHeader header = {REC_MAGIC, rec.samples, {rec.origin[0], rec.origin[1]}, rec.len};
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(rec.buf, 1, rec.len, file) == rec.len;
+  fclose(file);
+  return ok;
+}
+
+bool rec_load(Recorder& rec) {
+  if (rec.recording) {
+    return false;
+  }
+  FILE* file = fopen(REC_FILE + 1, "rb");
+  if (!file) {
+    return false;
+  }
+  RecFileHeader header;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == REC_MAGIC &&
+            header.len <= REC_BUF_BYTES && fread(rec.buf, 1, header.len, file) == header.len;
+  fclose(file);
+  if (!ok) {
+    rec.samples = 0;
+    rec.len = 0;
+    return false;
+  }
+  return rec_apply_header(rec, header);
+}
+#endif
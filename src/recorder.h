@@ -0,0 +1,54 @@
+// recorder.h
+//
+// Record-and-replay of manual jog trajectories.  Both axis positions are
+// sampled at a fixed rate and stored as zigzag varint deltas, which costs
+// about two bytes per sample for a hand jog.  The RAM copy can be saved to
+// and loaded from LittleFS.
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REC_BUF_BYTES 8192
+#define REC_PERIOD_US 20000  // 50 Hz sample rate
+#define REC_FILE "/jog.rec"
+
+struct Recorder {
+  uint8_t buf[REC_BUF_BYTES];
+  uint16_t len;
+  uint32_t samples;
+  int32_t origin[2];  // positions at rec_start()
+  int32_t last[2];
+  bool recording;
+  bool full;
+};
+
+struct RecPlayer {
+  const Recorder* rec;
+  uint16_t pos;
+  uint32_t index;
+  int32_t cur[2];
+};
+
+void rec_start(Recorder& rec, int32_t slider, int32_t rotator);
+
+/**
+ * Append one sample.
+ * @return false once the buffer is full, recording stops at that point
+ */
+bool rec_sample(Recorder& rec, int32_t slider, int32_t rotator);
+void rec_stop(Recorder& rec);
+
+uint32_t rec_duration_us(const Recorder& rec);
+uint32_t rec_bytes_per_minute(const Recorder& rec);
+
+void rec_play_start(RecPlayer& player, const Recorder& rec);
+bool rec_play_next(RecPlayer& player, int32_t& slider, int32_t& rotator);
+
+// LittleFS on the device, a file in the working directory on the host.
+bool rec_save(const Recorder& rec);
+bool rec_load(Recorder& rec);
+
+#endif  // RECORDER_H
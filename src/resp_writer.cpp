@@ -0,0 +1,113 @@
+// resp_writer.cpp
+
+#include "resp_writer.h"
+
+void resp_init(RespWriter& w, RespSink sink, uint16_t chunk) {
+  w.sink = sink;
+  w.len = 0;
+  w.first = true;
+  w.bytes = 0;
+  resp_set_chunk(w, chunk);
+}
+
+void resp_set_chunk(RespWriter& w, uint16_t chunk) {
+  resp_flush(w);
+  w.chunk = chunk == 0 ? RESP_CHUNK_DEFAULT : (chunk > RESP_CHUNK_MAX ? RESP_CHUNK_MAX : chunk);
+}
+
+void resp_flush(RespWriter& w) {
+  if (w.len && w.sink) {
+    w.sink(w.buf, w.len);
+    w.bytes += w.len;
+  }
+  w.len = 0;
+}
+
+void resp_char(RespWriter& w, char c) {
+  w.buf[w.len++] = c;
+  if (w.len == w.chunk) {
+    resp_flush(w);
+  }
+}
+
+void resp_str(RespWriter& w, const char* text) {
+  while (*text) {
+    resp_char(w, *text++);
+  }
+}
+
+void resp_uint(RespWriter& w, uint32_t v) {
+  // Digits come out backwards; count them first so they can be written in
+  // place when the chunk has room.
+  uint8_t digits = 1;
+  for (uint32_t t = v; t >= 10; t /= 10) {
+    digits++;
+  }
+  if (w.chunk - w.len < digits) {
+    resp_flush(w);
+  }
+  if (w.chunk - w.len >= digits) {
+    uint8_t* end = w.buf + w.len + digits;
+    do {
+      *--end = '0' + v % 10;
+      v /= 10;
+    } while (v);
+    w.len += digits;
+    if (w.len == w.chunk) {
+      resp_flush(w);
+    }
+    return;
+  }
+
+  // Chunk smaller than the number: go through a scratch buffer.
+  char tmp[10];
+  uint8_t n = 0;
+  do {
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  while (n) {
+    resp_char(w, tmp[--n]);
+  }
+}
+
+void resp_int(RespWriter& w, int32_t v) {
+  if (v < 0) {
+    resp_char(w, '-');
+    resp_uint(w, 0u - (uint32_t)v);
+  } else {
+    resp_uint(w, v);
+  }
+}
+
+void resp_obj_begin(RespWriter& w) {
+  resp_char(w, '{');
+  w.first = true;
+}
+
+void resp_key(RespWriter& w, const char* key) {
+  if (!w.first) {
+    resp_char(w, ',');
+  }
+  w.first = false;
+  resp_char(w, '"');
+  resp_str(w, key);
+  resp_str(w, "\":");
+}
+
+void resp_field_int(RespWriter& w, const char* key, int32_t v) {
+  resp_key(w, key);
+  resp_int(w, v);
+}
+
+// Values are fixed identifiers, nothing needs escaping.
+void resp_field_str(RespWriter& w, const char* key, const char* v) {
+  resp_key(w, key);
+  resp_char(w, '"');
+  resp_str(w, v);
+  resp_char(w, '"');
+}
+
+void resp_obj_end(RespWriter& w) {
+  resp_char(w, '}');
+}
@@ -0,0 +1,46 @@
+// resp_writer.h
+//
+// Allocation-free response writer.  Text and integers are formatted straight
+// into a fixed buffer the size of one BLE notification and handed to the sink
+// a chunk at a time, so no String, sprintf or heap is involved and every call
+// has a fixed upper bound on work (an integer is at most 11 characters).
+
+#ifndef RESP_WRITER_H
+#define RESP_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RESP_CHUNK_MAX 244  // 247 byte MTU less the 3 byte ATT header
+#define RESP_CHUNK_DEFAULT 20
+
+typedef void (*RespSink)(const uint8_t* buf, size_t len);
+
+struct RespWriter {
+  RespSink sink;
+  uint16_t chunk;  // bytes per sink call, <= RESP_CHUNK_MAX
+  uint16_t len;
+  bool first;      // no field written yet in the current object
+  uint32_t bytes;  // total handed to the sink
+  uint8_t buf[RESP_CHUNK_MAX];
+};
+
+void resp_init(RespWriter& w, RespSink sink, uint16_t chunk);
+void resp_set_chunk(RespWriter& w, uint16_t chunk);
+
+void resp_char(RespWriter& w, char c);
+void resp_str(RespWriter& w, const char* text);
+void resp_int(RespWriter& w, int32_t v);
+void resp_uint(RespWriter& w, uint32_t v);
+
+// JSON objects: {"key":value,...}
+void resp_obj_begin(RespWriter& w);
+void resp_key(RespWriter& w, const char* key);
+void resp_field_int(RespWriter& w, const char* key, int32_t v);
+void resp_field_str(RespWriter& w, const char* key, const char* v);
+void resp_obj_end(RespWriter& w);
+
+// Send whatever is buffered.
+void resp_flush(RespWriter& w);
+
+#endif  // RESP_WRITER_H
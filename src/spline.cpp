@@ -0,0 +1,112 @@
+// spline.cpp
+
+#include "spline.h"
+
+void spline_clear(Spline& spline) {
+  spline.count = 0;
+  spline.seg = 0;
+  spline.tick = 0;
+  spline.seg_ticks = 0;
+}
+
+bool spline_add(Spline& spline, int32_t pos, int32_t angle, uint32_t t_ms) {
+  if (spline.count == SPLINE_KEYS_MAX ||
+      (spline.count > 0 && t_ms <= spline.keys[spline.count - 1].t_ms)) {
+    return false;
+  }
+  SplineKey& key = spline.keys[spline.count++];
+  key.pos[0] = pos;
+  key.pos[1] = angle;
+  key.t_ms = t_ms;
+  return true;
+}
+
+// Catmull-Rom tangent at key i in steps per ms, zero at the ends.
+static float tangent(const Spline& spline, uint8_t i, uint8_t axis) {
+  if (i == 0 || i == spline.count - 1) {
+    return 0;
+  }
+  const SplineKey& prev = spline.keys[i - 1];
+  const SplineKey& next = spline.keys[i + 1];
+  return (float)(next.pos[axis] - prev.pos[axis]) / (float)(next.t_ms - prev.t_ms);
+}
+
+// Value and differences at u from the cubic, h = one tick.
+static void diff_seed(SplineDiff& d, float p0, float u, float h) {
+  float h2 = h * h;
+  float h3 = h2 * h;
+  d.base = p0 + ((d.a * u + d.b) * u + d.c) * u;
+  d.f = 0;
+  d.d1 = d.a * (3 * u * u * h + 3 * u * h2 + h3) + d.b * (2 * u * h + h2) + d.c * h;
+  d.d2 = d.a * (6 * u * h2 + 6 * h3) + 2 * d.b * h2;
+  d.d3 = 6 * d.a * h3;
+}
+
+// All the divisions happen here, once per segment.
+static void segment_setup(Spline& spline) {
+  const SplineKey& k0 = spline.keys[spline.seg];
+  const SplineKey& k1 = spline.keys[spline.seg + 1];
+  uint32_t span_ms = k1.t_ms - k0.t_ms;
+  uint32_t ticks = (uint64_t)span_ms * 1000 / SPLINE_TICK_US;  // spans past 71 min overflow 32 bits
+  spline.seg_ticks = ticks ? ticks : 1;
+  spline.tick = 0;
+
+  spline.h = 1.0f / spline.seg_ticks;
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    float p0 = k0.pos[axis];
+    float p1 = k1.pos[axis];
+    float m0 = tangent(spline, spline.seg, axis) * span_ms;
+    float m1 = tangent(spline, spline.seg + 1, axis) * span_ms;
+
+    SplineDiff& d = spline.axis[axis];
+    d.a = 2 * (p0 - p1) + m0 + m1;
+    d.b = 3 * (p1 - p0) - 2 * m0 - m1;
+    d.c = m0;
+    diff_seed(d, p0, 0, spline.h);
+  }
+}
+
+bool spline_start(Spline& spline) {
+  if (spline.count < 2) {
+    return false;
+  }
+  spline.seg = 0;
+  segment_setup(spline);
+  return true;
+}
+
+static int32_t round_steps(float v) {
+  return (int32_t)(v < 0 ? v - 0.5f : v + 0.5f);
+}
+
+bool spline_next(Spline& spline, int32_t& pos, int32_t& angle) {
+  if (spline.seg + 1 >= spline.count) {
+    return false;
+  }
+
+  if (++spline.tick >= spline.seg_ticks) {
+    // Land exactly on the key, so float error never carries into the next segment.
+    const SplineKey& key = spline.keys[++spline.seg];
+    pos = key.pos[0];
+    angle = key.pos[1];
+    if (spline.seg + 1 < spline.count) {
+      segment_setup(spline);
+    }
+    return true;
+  }
+
+  bool resync = spline.tick % SPLINE_RESYNC_TICKS == 0;
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    SplineDiff& d = spline.axis[axis];
+    if (resync) {
+      diff_seed(d, spline.keys[spline.seg].pos[axis], spline.tick * spline.h, spline.h);
+      continue;
+    }
+    d.f += d.d1;
+    d.d1 += d.d2;
+    d.d2 += d.d3;
+  }
+  pos = round_steps(spline.axis[0].base + spline.axis[0].f);
+  angle = round_steps(spline.axis[1].base + spline.axis[1].f);
+  return true;
+}
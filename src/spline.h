@@ -0,0 +1,64 @@
+// spline.h
+//
+// Multi-keyframe paths.  Keyframes (slider position, rotator angle, time) are
+// joined by cubic Hermite segments with Catmull-Rom tangents, which is the
+// same curve as a cubic Bezier with control points a third of a tangent away
+// from each key.  Each segment is evaluated by forward differencing at a fixed
+// control rate, so a tick costs three float adds per axis: no pow(), no
+// division.  Every SPLINE_RESYNC_TICKS the differences are worked out again
+// from the cubic itself, so float rounding cannot build up over a long
+// segment (a 60 minute one drifted 97 steps without).  The first and last
+// keys have zero tangents, easing in and out.
+
+#ifndef SPLINE_H
+#define SPLINE_H
+
+#include <stdint.h>
+
+#define SPLINE_KEYS_MAX 10
+#define SPLINE_TICK_US 10000  // 100 Hz control rate
+#define SPLINE_RESYNC_TICKS 100
+
+struct SplineKey {
+  int32_t pos[2];  // slider, rotator in steps
+  uint32_t t_ms;
+};
+
+struct SplineDiff {
+  float base;  // value at the last resync, f is relative to it so the adds stay small
+  float f;     // value at the current tick, less base
+  float d1;    // first, second and third forward differences
+  float d2;
+  float d3;
+  float a;     // p(u) = p0 + a u^3 + b u^2 + c u, u in [0, 1]
+  float b;
+  float c;
+};
+
+struct Spline {
+  SplineKey keys[SPLINE_KEYS_MAX];
+  uint8_t count;
+  uint8_t seg;         // current segment, keys[seg] to keys[seg + 1]
+  uint32_t tick;       // tick within the segment
+  uint32_t seg_ticks;
+  float h;             // 1 / seg_ticks
+  SplineDiff axis[2];
+};
+
+void spline_clear(Spline& spline);
+
+/**
+ * Append a keyframe.
+ * @return false if the path is full or t_ms is not after the previous key
+ */
+bool spline_add(Spline& spline, int32_t pos, int32_t angle, uint32_t t_ms);
+
+bool spline_start(Spline& spline);
+
+/**
+ * Advance one control tick.
+ * @return false once the last key has been reached
+ */
+bool spline_next(Spline& spline, int32_t& pos, int32_t& angle);
+
+#endif  // SPLINE_H
@@ -0,0 +1,282 @@
+// step_table.cpp
+
+#include "step_table.h"
+
+#include <string.h>
+
+#include "varint.h"
+
+void step_table_clear(StepTable& table) {
+  memset(table.axis, 0, sizeof(table.axis));
+  table.len = 0;
+}
+
+static bool put(StepTable& table, uint32_t v) {
+  size_t n = varint_put(table.data + table.len, STEP_TABLE_BYTES - table.len, v);
+  table.len += n;
+  return n != 0;
+}
+
+// A zero-delta run is a 0 token followed by its length.
+static bool flush_run(StepTable& table, uint32_t& run) {
+  bool ok = run == 0 || (put(table, 0) && put(table, run));
+  run = 0;
+  return ok;
+}
+
+bool step_table_compile(StepTable& table, uint8_t axis, int32_t dir, HwStepSource source,
+                        void* ctx) {
+  StepTableAxis& out = table.axis[axis];
+  out.offset = table.len;
+  out.dir = dir;
+  out.steps = 0;
+
+  uint32_t prev = 0;
+  uint32_t run = 0;
+  bool ok = true;
+  for (uint32_t interval = source(ctx); interval && ok; interval = source(ctx)) {
+    if (out.steps == 0) {
+      ok = put(table, interval);
+    } else if (interval == prev) {
+      run++;
+    } else {
+      ok = flush_run(table, run) && put(table, zigzag_encode(interval - prev));
+    }
+    prev = interval;
+    out.steps++;
+  }
+  ok = ok && flush_run(table, run);
+  out.bytes = table.len - out.offset;
+  return ok;
+}
+
+void step_table_stream_start(StepTableStream& stream, const StepTableAxis& axis,
+                             StepTableRead read, void* io) {
+  stream.read = read;
+  stream.io = io;
+  stream.file_pos = axis.offset;
+  stream.file_end = axis.offset + axis.bytes;
+  stream.chunk_len[0] = 0;
+  stream.chunk_len[1] = 0;
+  stream.active = 0;
+  stream.pos = 0;
+  stream.remaining = axis.steps;
+  stream.interval = 0;
+  stream.zero_run = 0;
+  stream.first = true;
+  stream.stalled = false;
+  stream.underruns = 0;
+  step_table_refill(stream);
+  step_table_refill(stream);
+}
+
+void step_table_refill(StepTableStream& stream) {
+  for (uint8_t i = 0; i < 2; i++) {
+    uint8_t c = stream.active ^ i;
+    if (stream.chunk_len[c] || stream.file_pos >= stream.file_end) {
+      continue;
+    }
+    size_t want = stream.file_end - stream.file_pos;
+    if (want > STEP_TABLE_CHUNK) {
+      want = STEP_TABLE_CHUNK;
+    }
+    size_t got = stream.read(stream.io, stream.file_pos, stream.chunk[c], want);
+    if (got == 0) {
+      stream.file_end = stream.file_pos;  // read error, end the move rather than stall
+    }
+    stream.file_pos += got;
+    stream.chunk_len[c] = got;
+    return;
+  }
+}
+
+static bool next_byte(StepTableStream& stream, uint8_t& b) {
+  if (stream.pos >= stream.chunk_len[stream.active]) {
+    uint8_t other = stream.active ^ 1;
+    if (!stream.chunk_len[other]) {
+      return false;
+    }
+    stream.chunk_len[stream.active] = 0;  // free for refill
+    stream.active = other;
+    stream.pos = 0;
+  }
+  b = stream.chunk[stream.active][stream.pos++];
+  return true;
+}
+
+static bool next_varint(StepTableStream& stream, uint32_t& v) {
+  v = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    uint8_t b;
+    if (!next_byte(stream, b)) {
+      return false;
+    }
+    v |= (uint32_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Ran out of loaded bytes part way through a token.  A token is far shorter
+// than a chunk, so the read never switched chunks and only pos goes back.
+static uint32_t underrun(StepTableStream& stream, uint16_t pos) {
+  if (stream.pos < stream.chunk_len[stream.active]) {
+    return 0;  // bytes left, so the varint was corrupt
+  }
+  if (stream.file_pos >= stream.file_end) {
+    return 0;  // the data ended before the step count did
+  }
+  stream.pos = pos;
+  if (!stream.stalled) {
+    stream.stalled = true;
+    stream.underruns++;
+  }
+  return STEP_TABLE_NOT_READY;
+}
+
+uint32_t step_table_next(void* ctx) {
+  StepTableStream& stream = *(StepTableStream*)ctx;
+  if (stream.remaining == 0) {
+    return 0;
+  }
+
+  uint16_t pos = stream.pos;
+  uint32_t token = 0;
+  uint32_t run = 0;
+  if (stream.zero_run) {
+    stream.zero_run--;
+  } else if (!next_varint(stream, token) ||
+             (!stream.first && token == 0 && !next_varint(stream, run))) {
+    return underrun(stream, pos);
+  } else if (stream.first) {
+    stream.interval = token;
+    stream.first = false;
+  } else if (token == 0) {
+    if (run == 0) {
+      return 0;
+    }
+    stream.zero_run = run - 1;
+  } else {
+    stream.interval += zigzag_decode(token);
+  }
+  stream.stalled = false;
+  stream.remaining--;
+  return stream.interval;
+}
+
+size_t step_table_ram_read(void* io, uint32_t offset, uint8_t* buf, size_t len) {
+  const StepTable& table = *(const StepTable*)io;
+  if (offset >= table.len) {
+    return 0;
+  }
+  if (len > table.len - offset) {
+    len = table.len - offset;
+  }
+  memcpy(buf, table.data + offset, len);
+  return len;
+}
+
+struct StepTableHeader {
+  uint32_t magic;
+  StepTableAxis axis[STEP_TABLE_AXES];
+  uint32_t len;
+};
+
+#define STEP_TABLE_MAGIC 0x31505453  // "STP1"
+
+#ifdef ARDUINO
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+
+using namespace Adafruit_LittleFS_Namespace;
+
+static File table_file(InternalFS);
+
+bool step_table_save(const StepTable& table) {
+  if (!InternalFS.begin()) {
+    return false;
+  }
+  table_file.close();
+  InternalFS.remove(STEP_TABLE_FILE);
+  File file = InternalFS.open(STEP_TABLE_FILE, FILE_O_WRITE);
+  if (!file) {
+    return false;
+  }
+
+  StepTableHeader header;
+  header.magic = STEP_TABLE_MAGIC;
+  memcpy(header.axis, table.axis, sizeof(header.axis));
+  header.len = table.len;
+  bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+            file.write(table.data, table.len) == table.len;
+  file.close();
+  return ok;
+}
+
+bool step_table_open(StepTableAxis axes[STEP_TABLE_AXES]) {
+  table_file.close();
+  if (!InternalFS.begin() || !table_file.open(STEP_TABLE_FILE, FILE_O_READ)) {
+    return false;
+  }
+  StepTableHeader header;
+  if (table_file.read(&header, sizeof(header)) != sizeof(header) ||
+      header.magic != STEP_TABLE_MAGIC) {
+    table_file.close();
+    return false;
+  }
+  memcpy(axes, header.axis, sizeof(header.axis));
+  return true;
+}
+
+size_t step_table_file_read(void* io, uint32_t offset, uint8_t* buf, size_t len) {
+  (void)io;
+  if (!table_file.seek(sizeof(StepTableHeader) + offset)) {
+    return 0;
+  }
+  int got = table_file.read(buf, len);
+  return got > 0 ? got : 0;
+}
+#else
+#include <stdio.h>
+
+static FILE* table_file;
+
+bool step_table_save(const StepTable& table) {
+  FILE* file = fopen(STEP_TABLE_FILE + 1, "wb");
+  if (!file) {
+    return false;
+  }
+  StepTableHeader header;
+  header.magic = STEP_TABLE_MAGIC;
+  memcpy(header.axis, table.axis, sizeof(header.axis));
+  header.len = table.len;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(table.data, 1, table.len, file) == table.len;
+  fclose(file);
+  return ok;
+}
+
+bool step_table_open(StepTableAxis axes[STEP_TABLE_AXES]) {
+  if (table_file) {
+    fclose(table_file);
+  }
+  table_file = fopen(STEP_TABLE_FILE + 1, "rb");
+  StepTableHeader header;
+  if (!table_file || fread(&header, sizeof(header), 1, table_file) != 1 ||
+      header.magic != STEP_TABLE_MAGIC) {
+    return false;
+  }
+  memcpy(axes, header.axis, sizeof(header.axis));
+  return true;
+}
+
+size_t step_table_file_read(void* io, uint32_t offset, uint8_t* buf, size_t len) {
+  (void)io;
+  if (!table_file || fseek(table_file, sizeof(StepTableHeader) + offset, SEEK_SET) != 0) {
+    return 0;
+  }
+  return fread(buf, 1, len, table_file);
+}
+#endif
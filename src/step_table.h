@@ -0,0 +1,89 @@
+// step_table.h
+//
+// Offline-compiled step interval tables.  A move is run through an interval
+// source (the hw_step ramp, or anything else with the same signature) once,
+// and the intervals are stored per axis as varint deltas with zero-delta runs
+// collapsed, so constant speed stretches cost a few bytes.  At run time each
+// step is a table fetch, streamed from LittleFS through two small chunks, and
+// every take produces exactly the same intervals.
+
+#ifndef STEP_TABLE_H
+#define STEP_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hw_step.h"
+
+#define STEP_TABLE_BYTES 8192
+#define STEP_TABLE_CHUNK 128
+#define STEP_TABLE_AXES 2
+#define STEP_TABLE_FILE "/move.stp"
+
+struct StepTableAxis {
+  uint32_t steps;
+  int32_t dir;
+  uint32_t offset;  // into data[] / past the file header
+  uint32_t bytes;
+};
+
+struct StepTable {
+  StepTableAxis axis[STEP_TABLE_AXES];
+  uint32_t len;
+  uint8_t data[STEP_TABLE_BYTES];
+};
+
+// Positional read from wherever the table lives.
+typedef size_t (*StepTableRead)(void* io, uint32_t offset, uint8_t* buf, size_t len);
+
+struct StepTableStream {
+  StepTableRead read;
+  void* io;
+  uint32_t file_pos;   // next byte to load
+  uint32_t file_end;
+  uint8_t chunk[2][STEP_TABLE_CHUNK];
+  volatile uint16_t chunk_len[2];  // 0 = empty, waiting for a refill
+  uint8_t active;
+  uint16_t pos;
+  uint32_t remaining;  // steps still to hand out
+  uint32_t interval;
+  uint32_t zero_run;
+  bool first;
+  bool stalled;        // the last call found the next chunk still empty
+  uint32_t underruns;  // stalls, each counted once however long it lasts
+};
+
+void step_table_clear(StepTable& table);
+
+/**
+ * Compile one axis by draining an interval source into the table.
+ * @return false if the table ran out of space
+ */
+bool step_table_compile(StepTable& table, uint8_t axis, int32_t dir, HwStepSource source,
+                        void* ctx);
+
+void step_table_stream_start(StepTableStream& stream, const StepTableAxis& axis,
+                             StepTableRead read, void* io);
+
+// Load the chunk that has been used up; call outside of interrupt context.
+void step_table_refill(StepTableStream& stream);
+
+// Returned by step_table_next() when the next chunk has not been loaded yet.
+#define STEP_TABLE_NOT_READY HW_STEP_NOT_READY
+
+/**
+ * HwStepSource: next interval in us, 0 at the end.  On a chunk underrun it
+ * returns STEP_TABLE_NOT_READY without consuming anything; call again once
+ * step_table_refill() has run.
+ */
+uint32_t step_table_next(void* ctx);
+
+// Reads straight from a table in RAM, io is the StepTable.
+size_t step_table_ram_read(void* io, uint32_t offset, uint8_t* buf, size_t len);
+
+// LittleFS on the device, a file in the working directory on the host.
+bool step_table_save(const StepTable& table);
+bool step_table_open(StepTableAxis axes[STEP_TABLE_AXES]);
+size_t step_table_file_read(void* io, uint32_t offset, uint8_t* buf, size_t len);
+
+#endif  // STEP_TABLE_H
@@ -0,0 +1,191 @@
+// tasks.cpp
+
+#include "tasks.h"
+
+#include "motors.h"
+
+TaskStats task_stats;
+static uint8_t idle_ticks;
+
+bool task_motion_tick(bool active) {
+  // Pending, not latched: the 'x' line acks the latch before the pass runs.
+  if (!active && ++idle_ticks < TASK_IDLE_WAKE_TICKS && !motion_estop_pending()) {
+    return false;
+  }
+  idle_ticks = 0;
+  return true;
+}
+
+void task_enter(TaskId id, uint32_t now_us) {
+  task_stats.task[id].enter_us = now_us;
+}
+
+void task_leave(TaskId id, uint32_t now_us) {
+  TaskStat& stat = task_stats.task[id];
+  uint32_t run_us = now_us - stat.enter_us;
+  stat.busy_us += run_us;
+  stat.runs++;
+  if (run_us > stat.max_us) {
+    stat.max_us = run_us;
+  }
+}
+
+uint16_t task_cpu_permille(TaskId id, uint32_t now_us) {
+  uint32_t window = now_us - task_stats.window_start_us;
+  if (window == 0) {
+    return 0;
+  }
+  return (uint64_t)task_stats.task[id].busy_us * 1000 / window;
+}
+
+void tasks_report(RespWriter& w, uint32_t now_us) {
+  static const char* const names[TASK_COUNT] = {"motion", "command", "telemetry"};
+  for (uint8_t id = 0; id < TASK_COUNT; id++) {
+    TaskStat& stat = task_stats.task[id];
+    resp_str(w, "task ");
+    resp_str(w, names[id]);
+    resp_str(w, ": ");
+    resp_uint(w, task_cpu_permille((TaskId)id, now_us));
+    resp_str(w, " permille cpu, ");
+    resp_uint(w, stat.runs);
+    resp_str(w, " runs, max ");
+    resp_uint(w, stat.max_us);
+    resp_str(w, " us, stack free ");
+    resp_uint(w, stat.stack_free);
+    resp_str(w, " B\n");
+    stat.busy_us = 0;
+    stat.runs = 0;
+    stat.max_us = 0;
+  }
+  task_stats.window_start_us = now_us;
+}
+
+#ifdef NRF52_SERIES
+
+#include <Arduino.h>
+
+#include "boot.h"
+#include "commands.h"
+#include "wear.h"
+
+// Stack depths in words
+#define MOTION_STACK 768
+#define COMMAND_STACK 1536  // LittleFS calls for the saves and table refills
+#define TELEMETRY_STACK 512
+#define COMMAND_POLL_MS 5  // Serial has no RX callback, and table refills
+
+static TaskHandle_t handles[TASK_COUNT];
+static QueueHandle_t request_queue;
+static QueueHandle_t result_queue;
+static TaskPoll command_poll_fn;
+static TaskPoll telemetry_poll_fn;
+static TaskSend send_fn;
+static volatile bool motion_active = true;
+
+// Motion timer interrupt, on each tick and step deadline: wake the motion
+// task (task_motion_tick()), and the command task when a "when:" command is
+// due.
+static void motion_wake() {
+  BaseType_t woken = pdFALSE;
+  if (command_due_ready(micros())) {
+    vTaskNotifyGiveFromISR(handles[TASK_COMMAND], &woken);
+  }
+  if (task_motion_tick(motion_active)) {
+    vTaskNotifyGiveFromISR(handles[TASK_MOTION], &woken);
+  }
+  portYIELD_FROM_ISR(woken);
+}
+
+// Command task side of the request queue: the motion task is higher
+// priority, so it has run the request by the time the result is waited for.
+static bool request_motion(const MotionRequest& request) {
+  bool ok = false;
+  xQueueSend(request_queue, &request, portMAX_DELAY);
+  xTaskNotifyGive(handles[TASK_MOTION]);
+  xQueueReceive(result_queue, &ok, portMAX_DELAY);
+  return ok;
+}
+
+// Replies are written out as they are made, the command task owns the links.
+static void send_reply(const uint8_t* buf, size_t len) {
+  send_fn(command_source(), buf, len);
+}
+
+static void motion_task(void* arg) {
+  (void)arg;
+  MotionRequest request;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    task_enter(TASK_MOTION, micros());
+    while (xQueueReceive(request_queue, &request, 0) == pdTRUE) {
+      bool ok = motion_request_run(request);
+      xQueueSend(result_queue, &ok, 0);
+    }
+    motion_run();
+    motion_active = motion_busy();
+    uint32_t due;
+    if (motion_active && motion_next_step(due)) {
+      motion_wake_at(due);
+    }
+    if (motion_active) {
+      boot_mark(BOOT_FIRST_MOVE, micros());
+    }
+    task_leave(TASK_MOTION, micros());
+  }
+}
+
+static void command_task(void* arg) {
+  (void)arg;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(COMMAND_POLL_MS));
+    task_enter(TASK_COMMAND, micros());
+    command_run_due(micros());
+    command_poll_fn();
+    table_refill();
+    wear_poll(wear, !motion_busy(), micros());
+    task_leave(TASK_COMMAND, micros());
+  }
+}
+
+static void telemetry_task(void* arg) {
+  (void)arg;
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(TASK_TELEMETRY_MS));
+    task_enter(TASK_TELEMETRY, micros());
+    telemetry_poll_fn();
+    for (uint8_t id = 0; id < TASK_COUNT; id++) {
+      task_stats.task[id].stack_free =
+          uxTaskGetStackHighWaterMark(handles[id]) * sizeof(StackType_t);
+    }
+    task_leave(TASK_TELEMETRY, micros());
+  }
+}
+
+void tasks_begin(TaskPoll command_poll, TaskSend send, TaskPoll telemetry_poll) {
+  command_poll_fn = command_poll;
+  send_fn = send;
+  telemetry_poll_fn = telemetry_poll;
+
+  // One deep: the command task is the only requester and waits for each.
+  request_queue = xQueueCreate(1, sizeof(MotionRequest));
+  result_queue = xQueueCreate(1, sizeof(bool));
+  command_set_reply(send_reply, RESP_CHUNK_MAX);  // peers split to their MTU
+  task_stats.window_start_us = micros();
+
+  xTaskCreate(motion_task, "motion", MOTION_STACK, NULL, TASK_PRIO_HIGHEST,
+              &handles[TASK_MOTION]);
+  xTaskCreate(command_task, "command", COMMAND_STACK, NULL, TASK_PRIO_NORMAL,
+              &handles[TASK_COMMAND]);
+  xTaskCreate(telemetry_task, "telemetry", TELEMETRY_STACK, NULL, TASK_PRIO_LOW,
+              &handles[TASK_TELEMETRY]);
+  motion_set_request_hook(request_motion);
+  motion_set_tick_hook(motion_wake);
+}
+
+void tasks_rx_notify() {
+  if (handles[TASK_COMMAND]) {
+    xTaskNotifyGive(handles[TASK_COMMAND]);
+  }
+}
+
+#endif  // NRF52_SERIES
@@ -0,0 +1,78 @@
+// tasks.h
+//
+// FreeRTOS task split.  Motion owns the steppers and runs at the highest
+// priority, woken by the motion timer; it only runs motion requests and the
+// motion pass.  The command task does all the BLE and Serial traffic, runs
+// the command lines and "when:" commands, and does the flash work (saves,
+// table refills, wear counters).  Commands reach the motors through a one
+// deep request queue (motors.h), the command task waiting for each result,
+// so the motion task never waits on BLE or flash.  The telemetry task runs at
+// a slow fixed period.
+//
+// The CPU share accounting and the motion wake rule are plain C++ and also
+// built on the host; only tasks_begin() and friends need FreeRTOS.
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "resp_writer.h"
+
+#define TASK_IDLE_WAKE_TICKS 25  // motion timer ticks between wakes when idle
+#define TASK_TELEMETRY_MS 500
+
+enum TaskId { TASK_MOTION, TASK_COMMAND, TASK_TELEMETRY, TASK_COUNT };
+
+struct TaskStat {
+  uint32_t busy_us;     // time between task_enter() and task_leave() this window
+  uint32_t enter_us;
+  uint32_t runs;
+  uint32_t max_us;      // longest single run
+  uint32_t stack_free;  // high-water mark, bytes never used
+};
+
+struct TaskStats {
+  TaskStat task[TASK_COUNT];
+  uint32_t window_start_us;
+};
+
+extern TaskStats task_stats;
+
+void task_enter(TaskId id, uint32_t now_us);
+void task_leave(TaskId id, uint32_t now_us);
+
+/**
+ * Called on each motion timer tick and step deadline: whether to wake the
+ * motion task.  Every time while motion is active or a stop is pending,
+ * every TASK_IDLE_WAKE_TICKS ticks otherwise so outputs still get switched
+ * off.  The simulator runs its passes by the same rule.
+ */
+bool task_motion_tick(bool active);
+
+/** @return share of the time since the last reset spent in the task, 0..1000 */
+uint16_t task_cpu_permille(TaskId id, uint32_t now_us);
+
+// One line per task, then start a new measurement window.
+void tasks_report(RespWriter& w, uint32_t now_us);
+
+#ifdef NRF52_SERIES
+typedef void (*TaskPoll)();
+
+// One reply chunk for the command's source (a peer id or COMMAND_LOCAL).
+typedef void (*TaskSend)(uint8_t source, const uint8_t* buf, size_t len);
+
+/**
+ * Start the three tasks.  command_poll is called by the command task to read
+ * BLE/Serial and feed command_feed(), and to send what is queued; send takes
+ * one reply chunk, also in the command task; telemetry_poll is called every
+ * TASK_TELEMETRY_MS.
+ */
+void tasks_begin(TaskPoll command_poll, TaskSend send, TaskPoll telemetry_poll);
+
+// Wake the command task, e.g. from the BLE UART RX callback.
+void tasks_rx_notify();
+#endif
+
+#endif  // TASKS_H
@@ -0,0 +1,72 @@
+// varint.h
+//
+// LEB128 style varints with zigzag mapping for signed deltas, used for the
+// compact on-flash formats and the binary wear report.
+
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+static inline uint32_t zigzag_encode(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+/**
+ * Append v to buf.
+ * @return bytes written, or 0 if fewer than 5 bytes were left and it did not fit
+ */
+static inline size_t varint_put(uint8_t* buf, size_t space, uint32_t v) {
+  size_t n = 0;
+  do {
+    if (n == space) {
+      return 0;
+    }
+    uint8_t b = v & 0x7f;
+    v >>= 7;
+    buf[n++] = v ? (b | 0x80) : b;
+  } while (v);
+  return n;
+}
+
+/**
+ * Append a 64 bit v to buf, the same encoding up to 10 bytes.
+ * @return bytes written, or 0 if it did not fit
+ */
+static inline size_t varint_put64(uint8_t* buf, size_t space, uint64_t v) {
+  // The low groups of a value past 32 bits, then the 32 bit encoder for the
+  // rest, so the common case stays on 32 bit shifts.
+  size_t n = 0;
+  while (v >> 32) {
+    if (n == space) {
+      return 0;
+    }
+    buf[n++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  size_t rest = varint_put(buf + n, space - n, (uint32_t)v);
+  return rest ? n + rest : 0;
+}
+
+/**
+ * Read a varint from buf.
+ * @return bytes consumed, or 0 if the buffer ended mid-value
+ */
+static inline size_t varint_get(const uint8_t* buf, size_t len, uint32_t* v) {
+  uint32_t out = 0;
+  for (size_t n = 0; n < len && n < 5; n++) {
+    out |= (uint32_t)(buf[n] & 0x7f) << (7 * n);
+    if (!(buf[n] & 0x80)) {
+      *v = out;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+#endif  // VARINT_H
@@ -0,0 +1,216 @@
+// wear.cpp
+
+#include "wear.h"
+
+#include <string.h>
+
+#include "varint.h"
+
+Wear wear;
+
+void wear_begin(Wear& wear, uint32_t now_us) {
+  memset(&wear, 0, sizeof(wear));
+  if (!wear_load(wear.life)) {
+    wear.life.magic = WEAR_MAGIC;
+  }
+  wear.life.boots++;
+  wear.dirty = true;
+  wear.saved_us = now_us;
+}
+
+// Peak speed over the window, from its first step to its last.
+static void wear_peak(Wear& wear, uint8_t axis, long travelled, uint32_t span_us) {
+  if (span_us == 0) {
+    return;
+  }
+  uint32_t speed = (uint64_t)(travelled < 0 ? -travelled : travelled) * 1000000 / span_us;
+  if (speed > wear.life.peak_speed[axis]) {
+    wear.life.peak_speed[axis] = speed;
+  }
+}
+
+static void wear_speed(Wear& wear, uint8_t axis, long position, uint32_t now_us) {
+  long moved = position - wear.position[axis];
+  long travelled = wear.position[axis] - wear.window_pos[axis];
+  if (!moved) {
+    if (wear.stepping[axis] && now_us - wear.step_us[axis] >= WEAR_GAP_US) {
+      wear_peak(wear, axis, travelled, wear.step_us[axis] - wear.window_us[axis]);
+      wear.stepping[axis] = false;  // before step_us can wrap, passes run every few ms
+    }
+    return;
+  }
+  if (wear.stepping[axis]) {
+    if (travelled && (moved < 0) != (travelled < 0)) {
+      wear_peak(wear, axis, travelled, wear.step_us[axis] - wear.window_us[axis]);
+    } else {
+      travelled += moved;
+      wear.step_us[axis] = now_us;
+      if (travelled > -WEAR_SPEED_STEPS && travelled < WEAR_SPEED_STEPS) {
+        return;
+      }
+      wear_peak(wear, axis, travelled, now_us - wear.window_us[axis]);
+    }
+  }
+  wear.window_pos[axis] = position;
+  wear.window_us[axis] = now_us;
+  wear.step_us[axis] = now_us;
+  wear.stepping[axis] = true;
+}
+
+void wear_update(Wear& wear, const long position[2], const uint64_t on_us[2], uint32_t now_us) {
+  wear_write_begin(wear);
+  for (uint8_t axis = 0; axis < 2; axis++) {
+    wear_speed(wear, axis, position[axis], now_us);
+    long moved = position[axis] - wear.position[axis];
+    if (moved) {
+      wear.life.steps[axis] += moved < 0 ? -moved : moved;
+      wear.position[axis] = position[axis];
+      wear.dirty = true;
+    }
+    wear.life.on_us[axis] += on_us[axis] - wear.on_us[axis];
+    wear.on_us[axis] = on_us[axis];
+  }
+  wear_write_end(wear);
+}
+
+void wear_snapshot(const Wear& wear, WearStats& stats) {
+  uint32_t seq;
+  do {
+    seq = wear.seq;
+    __sync_synchronize();
+    stats = wear.life;
+    __sync_synchronize();
+  } while ((seq & 1) || seq != wear.seq);
+}
+
+bool wear_poll(Wear& wear, bool idle, uint32_t now_us, bool force) {
+  if (!force && (!wear.dirty || !idle || now_us - wear.saved_us < WEAR_SAVE_US)) {
+    return false;
+  }
+  // Not retried before the next interval if it fails, flash errors are not
+  // worth hammering.  Cleared first, so a change made during the write marks
+  // the counters dirty again.
+  wear.saved_us = now_us;
+  wear.dirty = false;
+  WearStats stats;
+  wear_snapshot(wear, stats);
+  stats.saves++;
+  if (!wear_save(stats)) {
+    wear.dirty = true;
+    return false;
+  }
+  wear.life.saves++;  // only ever written here
+  return true;
+}
+
+size_t wear_report(const WearStats& stats, uint8_t* buf, size_t space) {
+  const uint64_t fields[] = {stats.boots, stats.saves, stats.limit_hits, stats.missed,
+                             stats.peak_speed[0], stats.peak_speed[1], stats.steps[0],
+                             stats.steps[1], stats.on_us[0] / 1000000, stats.on_us[1] / 1000000};
+  if (space < 2) {
+    return 0;
+  }
+  size_t len = 2;
+  for (uint8_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    size_t n = varint_put64(buf + len, space - len, fields[i]);
+    if (n == 0) {
+      return 0;
+    }
+    len += n;
+  }
+  buf[0] = 'W';
+  buf[1] = len - 2;
+  return len;
+}
+
+static bool wear_valid(const WearStats& stats) {
+  return stats.magic == WEAR_MAGIC;
+}
+
+#ifdef ARDUINO
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+
+using namespace Adafruit_LittleFS_Namespace;
+
+bool wear_load(WearStats& stats) {
+  if (!InternalFS.begin()) {
+    return false;
+  }
+  File file = InternalFS.open(WEAR_FILE, FILE_O_READ);
+  if (!file) {
+    return false;
+  }
+  WearStats loaded;
+  bool ok = file.read(&loaded, sizeof(loaded)) == sizeof(loaded) && wear_valid(loaded);
+  file.close();
+  if (ok) {
+    stats = loaded;
+  }
+  return ok;
+}
+
+// A power cut at any point leaves either the old counters or the new ones:
+// LittleFS renames over the old file atomically.
+bool wear_save(const WearStats& stats) {
+  if (!InternalFS.begin()) {
+    return false;
+  }
+  InternalFS.remove(WEAR_TMP_FILE);
+  File file = InternalFS.open(WEAR_TMP_FILE, FILE_O_WRITE);
+  if (!file) {
+    return false;
+  }
+  bool ok = file.write((const uint8_t*)&stats, sizeof(stats)) == sizeof(stats);
+  file.close();
+  return ok && InternalFS.rename(WEAR_TMP_FILE, WEAR_FILE);
+}
+#else
+#include <stdio.h>
+
+static const char* wear_path = NULL;
+static WearStats wear_stored;
+static bool wear_have_stored = false;
+
+void wear_set_file(const char* path) {
+  wear_path = path;
+}
+
+bool wear_load(WearStats& stats) {
+  if (!wear_path) {
+    if (wear_have_stored) {
+      stats = wear_stored;
+    }
+    return wear_have_stored;
+  }
+  FILE* file = fopen(wear_path, "rb");
+  if (!file) {
+    return false;
+  }
+  WearStats loaded;
+  bool ok = fread(&loaded, sizeof(loaded), 1, file) == 1 && wear_valid(loaded);
+  fclose(file);
+  if (ok) {
+    stats = loaded;
+  }
+  return ok;
+}
+
+bool wear_save(const WearStats& stats) {
+  if (!wear_path) {
+    wear_stored = stats;
+    wear_have_stored = true;
+    return true;
+  }
+  // Beside the file and renamed over it, as on the slider.
+  char tmp[256];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", wear_path);
+  FILE* file = fopen(tmp, "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(&stats, sizeof(stats), 1, file) == 1;
+  ok &= fclose(file) == 0;
+  return ok && rename(tmp, wear_path) == 0;
+}
+#endif
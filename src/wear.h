@@ -0,0 +1,123 @@
+// wear.h
+//
+// Lifetime counters for planning maintenance: steps and peak speed per axis,
+// coil on time, limit switch trips and missed step deadlines.  The motion
+// loop adds to them in RAM on every pass (a subtraction and an add per axis).
+// wear_poll() writes them to LittleFS only while the motors are idle, and at
+// most once per WEAR_SAVE_US, so a session costs a few flash writes.  It runs
+// in the command task and may be preempted by the motion task's updates, so
+// it saves a copy taken between two reads of the same, even, seq.  Counts
+// since the last write are lost on power off.  Coil time alone does not call
+// for a write, an axis held for ever would otherwise write every interval.
+// It comes from hold_on_us(), which adds up every pass, so it keeps counting
+// through the 71 minute wrap of the 32 bit microsecond clock.
+//
+// "wear?" replies with wear_report(): 'W', the payload length, then the
+// fields of WearStats after magic as varints, in order, with coil time in
+// seconds.
+//
+// Peak speed is timed over whole step intervals: a speed window opens on an
+// update that saw the axis step and closes on a later one, after
+// WEAR_SPEED_STEPS steps, a reversal or a pause of WEAR_GAP_US.  Software
+// steps are taken in motion passes, so their windows are as exact as the step
+// times; the hardware slider's count is only read on a pass.
+
+#ifndef WEAR_H
+#define WEAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WEAR_FILE "/wear.bin"
+#define WEAR_TMP_FILE "/wear.tmp"   // written first, then renamed over WEAR_FILE
+#define WEAR_MAGIC 0x31524557     // "WER1", bump when the layout changes
+#define WEAR_SAVE_US 300000000    // at most one write per 5 min
+#define WEAR_SPEED_STEPS 8        // peak speed is the fastest run of this many steps
+#define WEAR_GAP_US 1000000       // steps further apart are a pause, not a speed
+#define WEAR_LATE_US 1000         // a step or stream sample this late missed its deadline
+#define WEAR_REPORT_MAX 64
+
+struct WearStats {
+  uint32_t magic;
+  uint32_t boots;
+  uint32_t saves;          // writes to flash, this one included
+  uint32_t limit_hits;
+  uint32_t missed;         // late table steps and stream samples, table underruns
+  uint32_t peak_speed[2];  // steps/s, axis 0 = slider, 1 = rotator
+  uint64_t steps[2];       // either direction, i.e. distance travelled
+  uint64_t on_us[2];       // coils on
+};
+
+struct Wear {
+  WearStats life;
+  bool dirty;             // counts changed since the last write
+  uint32_t saved_us;      // last write, or boot
+  long position[2];       // at the last update
+  uint64_t on_us[2];      // coil time since boot at the last update
+  long window_pos[2];     // at the start of each axis's speed window
+  uint32_t window_us[2];
+  uint32_t step_us[2];    // last update that saw the axis step
+  bool stepping[2];       // a speed window is open
+  volatile uint32_t seq;  // odd while life is being updated
+};
+
+extern Wear wear;
+
+/** Load the saved counters (zeros if there are none) and count a boot. */
+void wear_begin(Wear& wear, uint32_t now_us);
+
+/**
+ * Add what happened since the last call.
+ * @param position steps, including any still being counted by hardware
+ * @param on_us coil on time since boot
+ */
+void wear_update(Wear& wear, const long position[2], const uint64_t on_us[2], uint32_t now_us);
+
+// Bracket every change the motion task makes to wear.life, see wear_poll().
+static inline void wear_write_begin(Wear& wear) {
+  wear.seq++;
+  __sync_synchronize();
+}
+
+static inline void wear_write_end(Wear& wear) {
+  __sync_synchronize();
+  wear.seq++;
+}
+
+static inline void wear_missed(Wear& wear, uint32_t count = 1) {
+  wear_write_begin(wear);
+  wear.life.missed += count;
+  wear.dirty = true;
+  wear_write_end(wear);
+}
+
+static inline void wear_limit(Wear& wear) {
+  wear_write_begin(wear);
+  wear.life.limit_hits++;
+  wear.dirty = true;
+  wear_write_end(wear);
+}
+
+// A copy of wear.life that no update was halfway through.
+void wear_snapshot(const Wear& wear, WearStats& stats);
+
+/**
+ * Write the counters out if they changed, the motors are idle and the last
+ * write is WEAR_SAVE_US ago, or at once with force.
+ * @return true if they were written
+ */
+bool wear_poll(Wear& wear, bool idle, uint32_t now_us, bool force = false);
+
+/** @return bytes of the binary report written to buf, 0 if it did not fit */
+size_t wear_report(const WearStats& stats, uint8_t* buf, size_t space);
+
+bool wear_load(WearStats& stats);
+bool wear_save(const WearStats& stats);
+
+#ifndef ARDUINO
+// Keep the counters in a file (the slider uses WEAR_FILE in flash).  Without
+// one they are kept in memory and start from zero every run.
+void wear_set_file(const char* path);
+#endif
+
+#endif  // WEAR_H